@@ -0,0 +1,16 @@
+#ifndef AGE_STRUCTURE_H
+#define AGE_STRUCTURE_H
+
+#include <vector>
+
+// Age groups of a population and who meets whom: groupFractions[g] is the share of
+// the population in group g, contactMatrix[a][b] the relative rate at which a person
+// of group a contacts people of group b. Empty means homogeneous mixing.
+struct AgeStructure {
+    std::vector<double> groupFractions;
+    std::vector<std::vector<double>> contactMatrix;
+
+    bool empty() const { return groupFractions.size() < 2; }
+};
+
+#endif // AGE_STRUCTURE_H
@@ -0,0 +1,84 @@
+#include "alias_table.h"
+#include "parallel.h"
+#include "random.h"
+#include <algorithm>
+
+void AliasTable::build(const std::vector<double>& newWeights) {
+    int n = static_cast<int>(newWeights.size());
+    weights = newWeights;
+    threshold.assign(n, 0xffffffffu);
+    alias.resize(n);
+    total = 0.0;
+    for (double& w : weights) {
+        w = std::max(w, 0.0);
+        total += w;
+    }
+    builtWeights = weights;
+    builtTotal = total;
+    exact = true;
+
+    std::vector<double> scaled(n);
+    std::vector<int> small, large;
+    for (int i = 0; i < n; ++i) {
+        alias[i] = i;
+        scaled[i] = total > 0.0 ? weights[i] * n / total : 1.0;
+        (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+    // Pair every under-full column with an over-full one that tops it up
+    while (!small.empty() && !large.empty()) {
+        int s = small.back(), l = large.back();
+        small.pop_back();
+        threshold[s] = static_cast<std::uint32_t>(scaled[s] * 4294967296.0);
+        alias[s] = l;
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Leftovers are full up to rounding
+    for (int i : small) threshold[i] = 0xffffffffu;
+}
+
+void AliasTable::setWeight(int index, double weight) {
+    weight = std::max(weight, 0.0);
+    if (weight > builtWeights[index] || builtTotal <= 0.0) {
+        std::vector<double> updated = weights;
+        updated[index] = weight;
+        build(updated);
+        return;
+    }
+    total += weight - weights[index];
+    weights[index] = weight;
+    exact = false;
+    // Keep the expected number of rejections per draw below one
+    if (total < 0.5 * builtTotal) {
+        build(std::vector<double>(weights));
+    }
+}
+
+int AliasTable::sampleWithRejection(std::uint64_t bits) const {
+    if (total <= 0.0) return pick(bits);
+    for (;;) {
+        int index = pick(bits);
+        bits = mixBits(bits);
+        // Keep index with probability weight / built weight
+        double accept = weights[index] / builtWeights[index];
+        if (static_cast<double>(bits >> 11) * 0x1.0p-53 < accept) {
+            return index;
+        }
+        bits = mixBits(bits + 0x9e3779b97f4a7c15ULL);
+    }
+}
+
+void AliasTable::sampleBatch(std::uint64_t stream, std::size_t count, int* out, int threadCount) const {
+    // Fixed-size chunks keyed by position, so any thread count produces the same draws
+    const std::size_t chunk = 1 << 14;
+    int chunks = static_cast<int>((count + chunk - 1) / chunk);
+    parallelFor(chunks, std::max(1, std::min(threadCount, chunks)), [&](int c, int) {
+        std::size_t end = std::min(count, (c + 1) * chunk);
+        for (std::size_t i = c * chunk; i < end; ++i) {
+            out[i] = sample(combineKeys(stream, i));
+        }
+    });
+}
@@ -0,0 +1,56 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Walker/Vose alias table: O(k) build over k weights, O(1) weighted draws.
+// Column i is kept with probability threshold[i] / 2^32, otherwise alias[i] is drawn.
+//
+// Weights can also be changed one at a time: a decrease only lowers the acceptance
+// probability of that index (draws reject and retry), an increase or a drop of the
+// total below half of the built total rebuilds the table.
+class AliasTable {
+public:
+    AliasTable() = default;
+    explicit AliasTable(const std::vector<double>& weights) { build(weights); }
+
+    // Rebuild for new weights; non-positive weights are never drawn. If every weight
+    // is zero the draws are uniform.
+    void build(const std::vector<double>& weights);
+
+    // Change one weight without a full rebuild where possible
+    void setWeight(int index, double weight);
+
+    int size() const { return static_cast<int>(threshold.size()); }
+    double weight(int index) const { return weights[index]; }
+
+    // Draw an index from 64 random bits: the high half picks the column, the low half the coin
+    int sample(std::uint64_t bits) const {
+        if (exact) return pick(bits);
+        return sampleWithRejection(bits);
+    }
+
+    // Draw count indices into out, draw i keyed by (stream, i), on threadCount threads.
+    // The result does not depend on the thread count.
+    void sampleBatch(std::uint64_t stream, std::size_t count, int* out, int threadCount = 1) const;
+
+private:
+    std::vector<std::uint32_t> threshold;
+    std::vector<int> alias;
+    std::vector<double> weights;      // Current weights
+    std::vector<double> builtWeights; // Weights the table was built for (upper bounds of weights)
+    double total = 0.0;
+    double builtTotal = 0.0;
+    bool exact = true;                // No weight lowered since the last build
+
+    int pick(std::uint64_t bits) const {
+        std::uint32_t column = static_cast<std::uint32_t>(((bits >> 32) * threshold.size()) >> 32);
+        return static_cast<std::uint32_t>(bits) < threshold[column] ? static_cast<int>(column) : alias[column];
+    }
+
+    int sampleWithRejection(std::uint64_t bits) const;
+};
+
+#endif // ALIAS_TABLE_H
@@ -0,0 +1,174 @@
+#include "simulation.h"
+#include "parallel.h"
+#include "random.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Micro-benchmarks for the simulation hot paths.
+// Usage: disease_bench [--warmup N] [--repetitions N] [--max-size N] [--filter TEXT]
+
+// Command line options shared by all benchmarks
+struct BenchOptions {
+    int warmup = 2;              // Untimed iterations before measuring
+    int repetitions = 5;         // Timed iterations, the median is reported
+    long long maxSize = 10000000; // Largest population size to benchmark (up to 100M)
+    std::string filter;          // Only run benchmarks whose name contains this text
+};
+
+static volatile long long benchSink = 0; // Keeps results alive so the work is not optimised away
+
+// Time body() warmup + repetitions times, calling setup() untimed before each call,
+// and print the median and minimum cost per unit of work.
+template <typename Setup, typename Body>
+static void runBenchmark(const BenchOptions& options, const std::string& name, const std::string& unit,
+                         double units, double bytesPerPerson, Setup setup, Body body) {
+    if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+        return;
+    }
+
+    std::vector<double> timings;
+    for (int i = 0; i < options.warmup + options.repetitions; ++i) {
+        setup();
+        auto begin = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        if (i >= options.warmup) {
+            timings.push_back(std::chrono::duration<double, std::nano>(end - begin).count() / units);
+        }
+    }
+    std::sort(timings.begin(), timings.end());
+
+    std::cout << std::left << std::setw(46) << name
+              << std::right << std::setw(12) << std::fixed << std::setprecision(2) << timings[timings.size() / 2]
+              << std::setw(12) << timings.front()
+              << "  ns/" << std::left << std::setw(12) << unit
+              << std::right << std::setw(10) << std::setprecision(1) << bytesPerPerson << "\n";
+}
+
+// Population of the given size with a fixed fraction of infectious individuals spread evenly
+static Population makePopulation(long long size, double prevalence) {
+    Population pop("Bench", static_cast<int>(size), 0.1);
+    long long infectious = std::max(1LL, static_cast<long long>(size * prevalence));
+    long long stride = std::max(1LL, size / infectious);
+    for (long long i = size - 1, n = 0; i >= 0 && n < infectious; i -= stride, ++n) {
+        pop.individuals[i].state = State::Infectious;
+    }
+    return pop;
+}
+
+static double bytesPerPerson(const Population& pop) {
+    return static_cast<double>(pop.individuals.capacity() * sizeof(Person)) / pop.individuals.size();
+}
+
+static std::vector<long long> populationSizes(const BenchOptions& options) {
+    std::vector<long long> sizes;
+    for (long long size = 1000; size <= std::min(options.maxSize, 100000000LL); size *= 10) {
+        sizes.push_back(size);
+    }
+    return sizes;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--warmup") options.warmup = std::stoi(argv[i + 1]);
+        else if (flag == "--repetitions") options.repetitions = std::max(1, std::stoi(argv[i + 1]));
+        else if (flag == "--max-size") options.maxSize = std::stoll(argv[i + 1]);
+        else if (flag == "--filter") options.filter = argv[i + 1];
+        else {
+            std::cerr << "Unknown option " << flag << "\n";
+            return 1;
+        }
+    }
+
+    seedRandomGenerator(12345);
+    std::cout << std::left << std::setw(46) << "Benchmark" << std::right << std::setw(12) << "median"
+              << std::setw(12) << "min" << "  " << std::left << std::setw(15) << "unit"
+              << std::right << std::setw(10) << "B/person" << "\n";
+
+    // Random number generation
+    const int draws = 1000000;
+    runBenchmark(options, "getRandomNumber", "call", draws, 0.0, [] {}, [&] {
+        long long sum = 0;
+        for (int i = 0; i < draws; ++i) sum += getRandomNumber(0, 100);
+        benchSink = sum;
+    });
+
+    // Weighted choice among 10000 populations, one draw at a time and as a parallel batch
+    std::vector<double> weights(10000);
+    for (std::size_t i = 0; i < weights.size(); ++i) weights[i] = 1.0 + static_cast<double>(i % 97);
+    AliasTable aliasTable(weights);
+    runBenchmark(options, "AliasTable::sample/10000", "draw", draws, 0.0, [] {}, [&] {
+        long long sum = 0;
+        for (int i = 0; i < draws; ++i) sum += aliasTable.sample(combineKeys(7, i));
+        benchSink = sum;
+    });
+    std::vector<int> batch(draws);
+    runBenchmark(options, "AliasTable::sampleBatch/10000", "draw", draws, 0.0, [] {}, [&] {
+        aliasTable.sampleBatch(7, batch.size(), batch.data(), resolveThreadCount(0));
+        benchSink = batch.back();
+    });
+
+    for (long long size : populationSizes(options)) {
+        std::string suffix = "/" + std::to_string(size);
+
+        // Counting one state is a full scan of the population
+        Population counted = makePopulation(size, 0.01);
+        runBenchmark(options, "countByState" + suffix, "person", size, bytesPerPerson(counted), [] {}, [&] {
+            benchSink = counted.countByState(State::Infectious);
+        });
+
+        // One simulated day at several infection prevalences, restored before each repetition
+        for (double prevalence : {0.001, 0.01, 0.1}) {
+            const Population initial = makePopulation(size, prevalence);
+            Population pop = initial;
+            std::string name = "simulateDay" + suffix + "/prevalence=" + std::to_string(prevalence).substr(0, 5);
+            runBenchmark(options, name, "person-day", size, bytesPerPerson(pop),
+                         [&] { pop.individuals = initial.individuals; },
+                         [&] { pop.simulateDay(3); });
+        }
+
+        // Imperfect vaccines at 10% prevalence, against the perfect-immunity day above
+        for (VaccineMode mode : {VaccineMode::Leaky, VaccineMode::AllOrNothing}) {
+            DiseaseModel model;
+            model.vaccineMode = mode;
+            model.vaccineEfficacy = 0.7;
+            const Population initial = makePopulation(size, 0.1);
+            Population pop = initial;
+            std::string name = std::string("simulateDay") + suffix +
+                               (mode == VaccineMode::Leaky ? "/leaky" : "/all-or-nothing");
+            runBenchmark(options, name, "person-day", size, bytesPerPerson(pop),
+                         [&] { pop.individuals = initial.individuals; },
+                         [&] { pop.simulateDay(model); });
+        }
+
+        // Contacts between two populations of this size
+        const std::vector<Population> initialPair = {makePopulation(size, 0.01), makePopulation(size, 0.01)};
+        Simulation sim(initialPair, 3, 0.15);
+        double contacts = std::max(1.0, 0.05 * size);
+        runBenchmark(options, "simulateInterPopulationContacts" + suffix, "contact", contacts,
+                     bytesPerPerson(initialPair[0]),
+                     [&] { sim.populations = initialPair; },
+                     [&] { sim.simulateInterPopulationContacts(); });
+    }
+
+    // CSV output path used by Simulation::start
+    const int rows = 1000000;
+    const std::string csvFilename = "bench_output.csv";
+    runBenchmark(options, "writeDailyRow", "row", rows, 0.0, [] {}, [&] {
+        std::ofstream outputFile(csvFilename);
+        for (int i = 0; i < rows; ++i) {
+            Simulation::writeDailyRow(outputFile, i / 4, "Regensburg", 1000000 + i, 1234, 56789, 300000);
+        }
+    });
+    std::remove(csvFilename.c_str());
+
+    return 0;
+}
@@ -0,0 +1,258 @@
+#include "config.h"
+#include "parallel.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Below this many bytes per chunk the thread start-up costs more than the parsing
+constexpr std::size_t minimumChunkBytes = 1 << 18;
+
+const char* trimStart(const char* begin, const char* end) {
+    while (begin < end && (*begin == ' ' || *begin == '\t')) ++begin;
+    return begin;
+}
+
+const char* trimEnd(const char* begin, const char* end) {
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) --end;
+    return end;
+}
+
+// Parse an optional number field; false if it is present but not a number
+bool parseOptionalNumber(const char* begin, const char* end, double& value) {
+    begin = trimStart(begin, end);
+    end = trimEnd(begin, end);
+    if (begin == end) return true;
+    auto result = std::from_chars(begin, end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+// Parse one "name,size,vaccination_rate[,mobility]" line; false for headers, blanks and malformed rows
+bool parsePopulationLine(const char* begin, const char* end, PopulationSpec& spec) {
+    const char* comma1 = std::find(begin, end, ',');
+    if (comma1 == end) return false;
+    const char* comma2 = std::find(comma1 + 1, end, ',');
+    const char* comma3 = comma2 == end ? end : std::find(comma2 + 1, end, ',');
+
+    const char* sizeBegin = trimStart(comma1 + 1, comma2);
+    const char* sizeEnd = trimEnd(sizeBegin, comma2);
+    auto sizeResult = std::from_chars(sizeBegin, sizeEnd, spec.size);
+    if (sizeResult.ec != std::errc() || sizeResult.ptr != sizeEnd) return false;
+
+    spec.vaccinationRate = 0.0;
+    spec.mobility = 1.0;
+    if (comma2 != end && !parseOptionalNumber(comma2 + 1, comma3, spec.vaccinationRate)) return false;
+    if (comma3 != end && !parseOptionalNumber(comma3 + 1, end, spec.mobility)) return false;
+
+    const char* nameBegin = trimStart(begin, comma1);
+    spec.name.assign(nameBegin, trimEnd(nameBegin, comma1));
+    return true;
+}
+
+// Parse every line starting in [begin, end) of a buffer that continues until limit
+void parsePopulationChunk(const char* begin, const char* end, const char* limit,
+                          std::vector<PopulationSpec>& specs, int& skipped) {
+    const char* line = begin;
+    while (line < end) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', limit - line));
+        if (lineEnd == nullptr) lineEnd = limit;
+        PopulationSpec spec;
+        if (parsePopulationLine(line, lineEnd, spec)) {
+            specs.push_back(std::move(spec));
+        } else if (trimEnd(line, lineEnd) != line) {
+            ++skipped;
+        }
+        line = lineEnd + 1;
+    }
+}
+
+} // namespace
+
+std::vector<PopulationSpec> readPopulationTable(const std::string& filename, int threadCount) {
+    std::vector<PopulationSpec> specs;
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        std::cerr << "Error: Could not open population table " << filename << ".\n";
+        if (fd >= 0) close(fd);
+        return specs;
+    }
+    std::size_t length = static_cast<std::size_t>(info.st_size);
+    if (length == 0) {
+        close(fd);
+        return specs;
+    }
+    void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error: Could not map population table " << filename << ".\n";
+        return specs;
+    }
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    const char* data = static_cast<const char*>(mapping);
+    const char* limit = data + length;
+
+    // A first line that isn't a population row is the header
+    const char* firstEnd = static_cast<const char*>(std::memchr(data, '\n', length));
+    PopulationSpec first;
+    const char* body = data;
+    if (!parsePopulationLine(data, firstEnd ? firstEnd : limit, first)) {
+        body = firstEnd ? firstEnd + 1 : limit;
+    }
+    length = limit - body;
+
+    // Chunk boundaries move forward to the next line start so each line is parsed once
+    int threads = resolveThreadCount(threadCount);
+    int chunks = static_cast<int>(std::max<std::size_t>(1, std::min<std::size_t>(
+        static_cast<std::size_t>(threads) * 4, length / minimumChunkBytes)));
+    std::vector<const char*> bounds(chunks + 1, limit);
+    bounds[0] = body;
+    for (int c = 1; c < chunks; ++c) {
+        const char* target = body + length / chunks * c;
+        const char* newline = static_cast<const char*>(std::memchr(target, '\n', limit - target));
+        bounds[c] = std::max(bounds[c - 1], newline ? newline + 1 : limit);
+    }
+
+    std::vector<std::vector<PopulationSpec>> parts(chunks);
+    std::vector<int> skipped(chunks, 0);
+    parallelFor(chunks, std::min(threads, chunks), [&](int c, int) {
+        parsePopulationChunk(bounds[c], bounds[c + 1], limit, parts[c], skipped[c]);
+    });
+    munmap(mapping, static_cast<std::size_t>(info.st_size));
+
+    std::size_t total = 0;
+    for (const auto& part : parts) total += part.size();
+    specs.reserve(total);
+    for (auto& part : parts) {
+        std::move(part.begin(), part.end(), std::back_inserter(specs));
+    }
+
+    int malformed = 0;
+    for (int count : skipped) malformed += count;
+    if (malformed > 0) {
+        std::cerr << "Warning: skipped " << malformed << " malformed lines in " << filename << ".\n";
+    }
+    return specs;
+}
+
+// Comma-separated numbers; false if any entry is not a number
+static bool parseNumbers(const std::string& text, std::vector<double>& values) {
+    std::size_t begin = 0;
+    while (begin <= text.size()) {
+        std::size_t end = std::min(text.find(',', begin), text.size());
+        const char* first = trimStart(text.data() + begin, text.data() + end);
+        const char* last = trimEnd(first, text.data() + end);
+        double value;
+        auto result = std::from_chars(first, last, value);
+        if (result.ec != std::errc() || result.ptr != last) return false;
+        values.push_back(value);
+        begin = end + 1;
+    }
+    return true;
+}
+
+AgeStructure parseAgeStructure(const std::string& groups, const std::string& matrix) {
+    AgeStructure ages;
+    if (groups.empty()) return ages;
+
+    bool valid = parseNumbers(groups, ages.groupFractions) && ages.groupFractions.size() <= 255;
+    std::size_t begin = 0;
+    while (valid && begin <= matrix.size()) {
+        std::size_t end = std::min(matrix.find('|', begin), matrix.size());
+        std::vector<double> row;
+        valid = parseNumbers(matrix.substr(begin, end - begin), row) && row.size() == ages.groupFractions.size();
+        ages.contactMatrix.push_back(row);
+        begin = end + 1;
+    }
+    valid = valid && ages.contactMatrix.size() == ages.groupFractions.size();
+
+    if (!valid) {
+        std::cerr << "Warning: ignoring age structure \"" << groups << "\" / \"" << matrix
+                  << "\", expected one contact matrix row of " << ages.groupFractions.size()
+                  << " values per group.\n";
+        return AgeStructure();
+    }
+
+    // Every row must reach some group, and only groups that have people
+    bool reachable = true;
+    for (const std::vector<double>& row : ages.contactMatrix) {
+        bool anyTarget = false;
+        for (std::size_t target = 0; target < row.size(); ++target) {
+            if (row[target] < 0.0 || (row[target] > 0.0 && !(ages.groupFractions[target] > 0.0))) reachable = false;
+            anyTarget = anyTarget || row[target] > 0.0;
+        }
+        reachable = reachable && anyTarget;
+    }
+    for (double fraction : ages.groupFractions) reachable = reachable && fraction >= 0.0;
+    if (!reachable) {
+        std::cerr << "Warning: ignoring age structure \"" << groups << "\" / \"" << matrix
+                  << "\", every contact matrix row needs a positive weight and only groups with a"
+                  << " positive fraction can be contacted.\n";
+        return AgeStructure();
+    }
+    return ages;
+}
+
+std::vector<PopulationSpec> readPopulationSpecs(const INIReader& reader) {
+    std::string populationFile = reader.Get("global", "population_file", "");
+    if (!populationFile.empty()) {
+        return readPopulationTable(populationFile);
+    }
+
+    int numPopulations = reader.GetInteger("global", "num_populations", 1);
+
+    std::vector<PopulationSpec> specs;
+    for (int i = 1; i <= numPopulations; ++i) {
+        std::string section = "population_" + std::to_string(i);
+        PopulationSpec spec;
+        spec.name = reader.Get(section, "name", "Unknown");
+        spec.size = reader.GetInteger(section, "size", 100);
+        spec.vaccinationRate = reader.GetReal(section, "vaccination_rate", 0.0);
+        spec.mobility = reader.GetReal(section, "mobility", 1.0);
+        spec.ages = parseAgeStructure(reader.Get(section, "age_groups", ""), reader.Get(section, "contact_matrix", ""));
+        specs.push_back(spec);
+    }
+    return specs;
+}
+
+bool parseModelType(const std::string& name, ModelType& type) {
+    for (int i = 0; i < static_cast<int>(std::size(modelDescriptions)); ++i) {
+        if (name == modelDescriptions[i].name) {
+            type = static_cast<ModelType>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+DiseaseModel readDiseaseModel(const INIReader& reader) {
+    DiseaseModel model(reader.GetInteger("disease", "duration", 3),
+                       reader.GetReal("disease", "transmissibility", 0.15),
+                       reader.GetInteger("disease", "contacts_per_day", 5));
+
+    std::string type = reader.Get("disease", "model", "sir");
+    if (!parseModelType(type, model.type)) {
+        std::cerr << "Warning: unknown disease model " << type << ", using sir.\n";
+    }
+    model.latentPeriod = reader.GetInteger("disease", "latent_period", model.latentPeriod);
+    model.immunityDuration = reader.GetInteger("disease", "immunity_duration", model.immunityDuration);
+    model.setBreakthroughRate(reader.GetReal("disease", "breakthrough_rate", 0.0));
+    model.maxDays = reader.GetInteger("disease", "max_days", 0);
+    model.mixingRate = reader.GetReal("disease", "mixing_rate", model.mixingRate);
+
+    model.vaccineEfficacy = reader.GetReal("disease", "vaccine_efficacy", 1.0);
+    std::string vaccineMode = reader.Get("disease", "vaccine_mode", "leaky");
+    if (vaccineMode == "all_or_nothing") {
+        model.vaccineMode = VaccineMode::AllOrNothing;
+    } else if (vaccineMode != "leaky") {
+        std::cerr << "Warning: unknown vaccine mode " << vaccineMode << ", using leaky.\n";
+    }
+    return model;
+}
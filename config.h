@@ -0,0 +1,37 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "INIReader.h"
+#include "disease_model.h"
+#include "age_structure.h"
+#include <string>
+#include <vector>
+
+// Description of one population as read from the configuration file
+struct PopulationSpec {
+    std::string name;
+    int size;
+    double vaccinationRate;
+    AgeStructure ages = {};   // Optional age groups and contact matrix
+    double mobility = 1.0;    // Relative weight in inter-population contacts
+};
+
+// Read the populations: from the table named by [global] population_file when set,
+// otherwise from the [population_<i>] sections for i = 1..num_populations, including
+// their optional age_groups and contact_matrix keys
+std::vector<PopulationSpec> readPopulationSpecs(const INIReader& reader);
+
+// Read the disease model (duration, transmissibility, contacts_per_day, mixing_rate,
+// model type and its parameters) from the [disease] section
+DiseaseModel readDiseaseModel(const INIReader& reader);
+
+// Parse "age_groups = f1,f2,..." and "contact_matrix = r11,r12,... | r21,r22,... | ...".
+// Returns an empty structure (homogeneous mixing) if they are missing or inconsistent.
+AgeStructure parseAgeStructure(const std::string& groups, const std::string& matrix);
+
+// Parse a "name,size,vaccination_rate[,mobility]" CSV table (optional header line) by mapping
+// the file and splitting it into line-aligned chunks parsed on threadCount threads.
+// Rows keep their file order; returns an empty table if the file can't be read.
+std::vector<PopulationSpec> readPopulationTable(const std::string& filename, int threadCount = 0);
+
+#endif // CONFIG_H
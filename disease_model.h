@@ -0,0 +1,97 @@
+#ifndef DISEASE_MODEL_H
+#define DISEASE_MODEL_H
+
+#include <string>
+
+// Compartment structures the day kernel is compiled for
+enum class ModelType { SIR, SEIR, SEIRS, SIRV };
+
+// Transitions a model type adds to S -> I -> R, one row per ModelType
+struct ModelDescription {
+    const char* name;
+    bool latent;        // S -> E -> I after the latent period
+    bool waning;        // R -> S after the immunity duration
+    bool breakthrough;  // V -> I on contact with the breakthrough probability
+};
+
+constexpr ModelDescription modelDescriptions[] = {
+    {"sir", false, false, false},
+    {"seir", true, false, false},
+    {"seirs", true, true, false},
+    {"sirv", false, false, true},
+};
+
+constexpr const ModelDescription& describe(ModelType type) {
+    return modelDescriptions[static_cast<int>(type)];
+}
+
+// Compile-time view of one row of the table, used to instantiate the specialised kernels
+template <ModelType Type>
+struct ModelTraits {
+    static constexpr bool latent = describe(Type).latent;
+    static constexpr bool waning = describe(Type).waning;
+    static constexpr bool breakthrough = describe(Type).breakthrough;
+};
+
+// How a vaccine with efficacy below 1 protects: leaky lowers the transmission probability
+// of every contact by the efficacy, all-or-nothing fully protects a fraction efficacy of
+// the vaccinated and leaves the rest susceptible. Perfect is efficacy 1 in either mode.
+enum class VaccineMode { Perfect, Leaky, AllOrNothing };
+
+// Look up a model type by its name ("sir", "seir", ...); false if unknown
+bool parseModelType(const std::string& name, ModelType& type);
+
+// Smallest draw d in [0, 101] with d / 100.0 >= probability, so "draw < threshold" on a
+// draw in [0, 100] accepts exactly the draws "draw / 100.0 < probability" did
+inline int drawThreshold(double probability) {
+    int threshold = 0;
+    while (threshold <= 100 && threshold / 100.0 < probability) {
+        threshold++;
+    }
+    return threshold;
+}
+
+// Disease parameters in the form the day kernel uses them
+struct DiseaseModel {
+    int duration;              // Days a person is infectious
+    double transmissibility;   // Probability of transmission per contact
+    int contactsPerDay;        // Random contacts of every infectious person per day
+    int transmissionThreshold; // A contact infects when its draw in [0, 100] is below this
+    double mixingRate = 0.05;  // Daily inter-population contacts, as a fraction of the smaller population
+
+    ModelType type = ModelType::SIR;
+    int latentPeriod = 2;          // Days exposed before becoming infectious (SEIR, SEIRS)
+    int immunityDuration = 180;    // Days recovered before becoming susceptible again (SEIRS)
+    double breakthroughRate = 0.0; // Transmission probability per contact with a vaccinated person (SIRV)
+    int breakthroughThreshold = 0;
+    int maxDays = 0;               // Stop after this many days even if infections remain, 0 = never
+    VaccineMode vaccineMode = VaccineMode::Leaky;
+    double vaccineEfficacy = 1.0;  // Protection of the vaccinated (all models except sirv)
+
+    DiseaseModel(int duration = 3, double transmissibility = 0.15, int contactsPerDay = 5)
+        : duration(duration), transmissibility(transmissibility), contactsPerDay(contactsPerDay),
+          transmissionThreshold(drawThreshold(transmissibility)) {}
+
+    void setTransmissibility(double probability) {
+        transmissibility = probability;
+        transmissionThreshold = drawThreshold(probability);
+    }
+
+    void setBreakthroughRate(double rate) {
+        breakthroughRate = rate;
+        breakthroughThreshold = drawThreshold(rate);
+    }
+
+    bool hasExposed() const { return describe(type).latent; }
+
+    // Vaccine handling the kernel is instantiated with; sirv uses breakthroughRate instead
+    VaccineMode vaccineKernel() const {
+        if (vaccineEfficacy >= 1.0 || describe(type).breakthrough) return VaccineMode::Perfect;
+        return vaccineMode;
+    }
+
+    // Leaky: infection probability per contact with a vaccinated person
+    double leakyTransmissibility() const { return transmissibility * (1.0 - vaccineEfficacy); }
+};
+
+#endif // DISEASE_MODEL_H
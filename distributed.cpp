@@ -0,0 +1,177 @@
+#include "distributed.h"
+#include "parallel.h"
+#include <algorithm>
+
+static int commRank(MPI_Comm comm) {
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+    return rank;
+}
+
+static int commSize(MPI_Comm comm) {
+    int size = 1;
+    MPI_Comm_size(comm, &size);
+    return size;
+}
+
+// Populations balanced over the processes by size, the cost of simulating them
+static std::vector<int> assignOwners(const std::vector<PopulationSpec>& specs, int ranks) {
+    std::vector<double> costs;
+    for (const auto& spec : specs) {
+        costs.push_back(spec.size);
+    }
+    return balanceByCost(costs, ranks);
+}
+
+// Individuals only for the held populations; the others keep their name and mobility
+static std::vector<Population> buildPopulations(const std::vector<PopulationSpec>& specs,
+                                                const std::vector<int>& owners, int rank) {
+    std::vector<Population> populations;
+    for (size_t p = 0; p < specs.size(); ++p) {
+        const PopulationSpec& spec = specs[p];
+        if (owners[p] == rank) {
+            populations.emplace_back(spec.name, spec.size, spec.vaccinationRate, spec.ages);
+        } else {
+            populations.emplace_back(spec.name, 0, spec.vaccinationRate);
+        }
+        populations.back().mobility = spec.mobility;
+    }
+    return populations;
+}
+
+DistributedSimulation::DistributedSimulation(const std::vector<PopulationSpec>& specs, const DiseaseModel& model,
+                                             unsigned int seed, MPI_Comm comm)
+    : comm(comm), rank(commRank(comm)), ranks(commSize(comm)), owners(assignOwners(specs, ranks)),
+      sim(buildPopulations(specs, owners, rank), model) {
+    for (const auto& spec : specs) {
+        sizes.push_back(spec.size);
+    }
+
+    // Keyed draws make every population's randomness independent of where it runs
+    sim.useCommonRandomNumbers(seed);
+    for (size_t p = 0; p < specs.size(); ++p) {
+        if (owners[p] == rank) {
+            sim.populations[p].initializeInfection();
+        }
+    }
+}
+
+void DistributedSimulation::run(std::ostream& output) {
+    if (rank == 0) {
+        output << Simulation::dailyHeader(sim.getModel());
+    }
+    while (simulateNextDay(output)) {
+    }
+
+    std::vector<int> held;
+    std::vector<StateCounts> counts;
+    for (size_t p = 0; p < owners.size(); ++p) {
+        if (owners[p] == rank) {
+            held.push_back(p);
+            counts.push_back(sim.populations[p].countStates());
+        }
+    }
+    finalCounts = gatherCounts(held, counts);
+}
+
+bool DistributedSimulation::simulateNextDay(std::ostream& output) {
+    sim.dayCount++;
+    const DiseaseModel& today = sim.modelForDay(sim.dayCount);
+
+    std::vector<int> held;
+    std::vector<StateCounts> counts;
+    int hasInfectious = 0;
+    for (size_t p = 0; p < owners.size(); ++p) {
+        if (owners[p] != rank) continue;
+        Population& pop = sim.populations[p];
+        held.push_back(p);
+        counts.push_back(sim.simulatePopulationDay(pop, today));
+        sim.personDays += pop.individuals.size();
+        if (counts.back()[static_cast<int>(State::Infectious)] + counts.back()[static_cast<int>(State::Exposed)] > 0) {
+            hasInfectious = 1;
+        }
+    }
+
+    std::vector<StateCounts> all = gatherCounts(held, counts);
+    if (rank == 0) {
+        for (size_t p = 0; p < all.size(); ++p) {
+            Simulation::writeDailyRow(output, sim.dayCount, sim.populations[p].name, all[p], sim.getModel());
+        }
+    }
+
+    int anyInfectious = 0;
+    MPI_Allreduce(&hasInfectious, &anyInfectious, 1, MPI_INT, MPI_LOR, comm);
+
+    exchangeInfections();
+    int maxDays = sim.getModel().maxDays;
+    return anyInfectious && (maxDays <= 0 || sim.dayCount < maxDays);
+}
+
+void DistributedSimulation::exchangeInfections() {
+    // Every process draws the same partners and contacts; each reports the infectious ones
+    // among the individuals it holds
+    std::vector<ContactInfection> infections;
+    sim.collectInterPopulationInfections(sizes, infections);
+
+    // One (population, person, draw) batch per destination process
+    std::vector<int> sendCounts(ranks, 0);
+    for (const auto& infection : infections) {
+        sendCounts[owners[infection.population]] += 3;
+    }
+    std::vector<int> sendOffsets(ranks, 0);
+    for (int r = 1; r < ranks; ++r) {
+        sendOffsets[r] = sendOffsets[r - 1] + sendCounts[r - 1];
+    }
+    std::vector<std::uint64_t> sendBuffer(3 * infections.size());
+    std::vector<int> next(sendOffsets);
+    for (const auto& infection : infections) {
+        int& offset = next[owners[infection.population]];
+        sendBuffer[offset++] = infection.population;
+        sendBuffer[offset++] = infection.person;
+        sendBuffer[offset++] = infection.draw;
+    }
+
+    std::vector<int> receiveCounts(ranks, 0);
+    MPI_Alltoall(sendCounts.data(), 1, MPI_INT, receiveCounts.data(), 1, MPI_INT, comm);
+    std::vector<int> receiveOffsets(ranks, 0);
+    for (int r = 1; r < ranks; ++r) {
+        receiveOffsets[r] = receiveOffsets[r - 1] + receiveCounts[r - 1];
+    }
+    std::vector<std::uint64_t> receiveBuffer(receiveOffsets.back() + receiveCounts.back());
+    MPI_Alltoallv(sendBuffer.data(), sendCounts.data(), sendOffsets.data(), MPI_UINT64_T,
+                  receiveBuffer.data(), receiveCounts.data(), receiveOffsets.data(), MPI_UINT64_T, comm);
+
+    // A person is infected if any of their draws succeeds, so the arrival order doesn't matter
+    const DiseaseModel& today = sim.modelForDay(sim.dayCount);
+    for (size_t i = 0; i + 2 < receiveBuffer.size(); i += 3) {
+        sim.infectByContact(sim.populations[receiveBuffer[i]], static_cast<int>(receiveBuffer[i + 1]),
+                            receiveBuffer[i + 2], today);
+    }
+}
+
+std::vector<StateCounts> DistributedSimulation::gatherCounts(const std::vector<int>& held,
+                                                             const std::vector<StateCounts>& counts) const {
+    // Each held population as (population, counts...)
+    std::vector<int> local;
+    for (size_t i = 0; i < held.size(); ++i) {
+        local.push_back(held[i]);
+        local.insert(local.end(), counts[i].begin(), counts[i].end());
+    }
+
+    int localSize = local.size();
+    std::vector<int> sizesByRank(ranks, 0);
+    MPI_Gather(&localSize, 1, MPI_INT, sizesByRank.data(), 1, MPI_INT, 0, comm);
+    std::vector<int> offsets(ranks, 0);
+    for (int r = 1; r < ranks; ++r) {
+        offsets[r] = offsets[r - 1] + sizesByRank[r - 1];
+    }
+    std::vector<int> gathered(rank == 0 ? offsets.back() + sizesByRank.back() : 0);
+    MPI_Gatherv(local.data(), localSize, MPI_INT, gathered.data(), sizesByRank.data(), offsets.data(),
+                MPI_INT, 0, comm);
+
+    std::vector<StateCounts> all(rank == 0 ? owners.size() : 0);
+    for (size_t i = 0; i + stateCount < gathered.size(); i += stateCount + 1) {
+        std::copy(gathered.begin() + i + 1, gathered.begin() + i + 1 + stateCount, all[gathered[i]].begin());
+    }
+    return all;
+}
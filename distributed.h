@@ -0,0 +1,56 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "simulation.h"
+#include "config.h"
+#include "intervention.h"
+#include <mpi.h>
+#include <ostream>
+#include <vector>
+
+// Multi-population run across MPI processes. Every process holds the individuals of its
+// share of the populations (balanced by size) and simulates their days locally; the only
+// state exchanged is the day's inter-population infections, batched into one all-to-all.
+// All draws are keyed by the seed, so the daily rows equal those of the single-process
+// run with keyed_random = true and the same seed, for any number of processes.
+class DistributedSimulation {
+public:
+    DistributedSimulation(const std::vector<PopulationSpec>& specs, const DiseaseModel& model,
+                          unsigned int seed, MPI_Comm comm = MPI_COMM_WORLD);
+
+    void setInterventions(const std::vector<InterventionRule>& rules) { sim.setInterventions(rules); }
+
+    // Run until no one is infectious; rank 0 writes the header and the daily rows in
+    // population order to output, the other ranks don't touch it
+    void run(std::ostream& output);
+
+    // Final counts of every population, on rank 0 after run
+    const std::vector<StateCounts>& getFinalCounts() const { return finalCounts; }
+    const std::vector<Population>& getPopulations() const { return sim.populations; }
+    int getDayCount() const { return sim.getDayCount(); }
+    int getRank() const { return rank; }
+
+    // Process holding each population
+    const std::vector<int>& getOwners() const { return owners; }
+
+private:
+    MPI_Comm comm;
+    int rank;
+    int ranks;
+    std::vector<int> owners;              // Process holding each population
+    std::vector<int> sizes;               // Size of every population, held here or not
+    Simulation sim;                       // All populations, those held elsewhere without individuals
+    std::vector<StateCounts> finalCounts;
+
+    // Advance the held populations by one day, write the day's rows on rank 0 and exchange
+    // the inter-population infections. Returns true while anyone is infectious.
+    bool simulateNextDay(std::ostream& output);
+
+    // Send every infection to the process holding its population and apply those received
+    void exchangeInfections();
+
+    // Counts of the held populations gathered on rank 0, in population order
+    std::vector<StateCounts> gatherCounts(const std::vector<int>& held, const std::vector<StateCounts>& counts) const;
+};
+
+#endif // DISTRIBUTED_H
@@ -0,0 +1,76 @@
+#include "estimator.h"
+#include "config.h"
+#include "parallel.h"
+#include "simulation.h"
+#include "INIReader.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+RunEstimate estimateRun(const INIReader& reader, int sampleSize) {
+    std::vector<PopulationSpec> specs = readPopulationSpecs(reader);
+    RunEstimate estimate;
+    estimate.populations = static_cast<int>(specs.size());
+    estimate.runs = std::max(1L, reader.GetInteger("global", "simulation_runs", 3));
+    estimate.threads = resolveThreadCount(reader.GetInteger("global", "threads", 1));
+
+    int largest = 1;
+    double vaccination = 0.0;
+    for (const auto& spec : specs) {
+        estimate.people += spec.size;
+        largest = std::max(largest, spec.size);
+        vaccination += spec.vaccinationRate * spec.size;
+    }
+    vaccination = estimate.people > 0 ? vaccination / estimate.people : 0.0;
+
+    // Calibration: one population with the average vaccination rate, run to extinction
+    estimate.sampleSize = std::max(2, std::min(sampleSize, largest));
+    Population sample("Calibration", estimate.sampleSize, vaccination);
+    sample.initializeInfection();
+    std::vector<Population> samplePopulations;
+    samplePopulations.push_back(std::move(sample));
+    Simulation sim(std::move(samplePopulations), readDiseaseModel(reader));
+
+    std::ostringstream rows;
+    auto begin = std::chrono::steady_clock::now();
+    while (sim.simulateNextDay(rows)) {
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    estimate.sampleDays = sim.getDayCount();
+    estimate.personDaysPerSecond = seconds > 0.0 ? sim.getPersonDays() / seconds : 0.0;
+    double bytesPerRow = static_cast<double>(rows.str().size()) / std::max(1, estimate.sampleDays);
+
+    // Epidemic length grows roughly with the logarithm of the population size
+    double growth = std::log(static_cast<double>(largest)) / std::log(static_cast<double>(estimate.sampleSize));
+    estimate.expectedDays = static_cast<int>(std::ceil(estimate.sampleDays * std::max(1.0, growth)));
+
+    estimate.personDays = static_cast<double>(estimate.people) * estimate.expectedDays * estimate.runs;
+    int parallelRuns = std::min(estimate.threads, estimate.runs);
+    estimate.wallSeconds = estimate.personDaysPerSecond > 0.0
+        ? estimate.personDays / (estimate.personDaysPerSecond * parallelRuns) : 0.0;
+    estimate.outputBytes = static_cast<std::uint64_t>(
+        bytesPerRow * estimate.expectedDays * estimate.populations * estimate.runs);
+
+    estimate.memory = estimateMemory(reader, estimate.expectedDays);
+    return estimate;
+}
+
+void RunEstimate::print(std::ostream& out) const {
+    out << "\nJob Estimate:\n";
+    out << "--------------------------------------------------\n";
+    out << "Populations:            " << populations << " (" << people << " people)\n";
+    out << "Runs:                   " << runs << " on " << threads << " threads\n";
+    out << "Calibration:            " << sampleSize << " people, " << sampleDays << " days, "
+        << std::fixed << std::setprecision(0) << personDaysPerSecond << " person-days/s\n";
+    out << "Expected days per run:  " << expectedDays << "\n";
+    out << "Projected person-days:  " << std::setprecision(3) << std::scientific << personDays << "\n";
+    out << "Projected wall time:    " << std::fixed << std::setprecision(1) << wallSeconds << " s\n";
+    out << "Projected output:       " << std::setprecision(2) << outputBytes / 1048576.0 << " MiB\n";
+    out << "--------------------------------------------------\n";
+    out << std::defaultfloat;
+    memory.print(out);
+}
@@ -0,0 +1,32 @@
+#ifndef ESTIMATOR_H
+#define ESTIMATOR_H
+
+#include "memory.h"
+#include <cstdint>
+#include <ostream>
+
+class INIReader;
+
+// Projected cost of running a configuration on the current machine
+struct RunEstimate {
+    MemoryEstimate memory;
+    int populations = 0;
+    std::uint64_t people = 0;
+    int runs = 0;
+    int threads = 0;
+    int sampleSize = 0;             // People in the calibration population
+    int sampleDays = 0;             // Days the calibration epidemic lasted
+    double personDaysPerSecond = 0; // Measured single-thread throughput
+    int expectedDays = 0;           // Projected days per run
+    double personDays = 0;          // Projected person-days of the whole job
+    double wallSeconds = 0;
+    std::uint64_t outputBytes = 0;
+
+    void print(std::ostream& out) const;
+};
+
+// Estimate memory from the configuration, then calibrate throughput and epidemic
+// length by simulating a sample population of at most sampleSize people to the end
+RunEstimate estimateRun(const INIReader& reader, int sampleSize = 20000);
+
+#endif // ESTIMATOR_H
@@ -0,0 +1,78 @@
+#include "intervention.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+// Apply one setting to a day's model; false if the key is unknown
+static bool applySetting(DiseaseModel& model, const std::string& key, double value) {
+    if (key == "transmissibility") {
+        model.setTransmissibility(value);
+    } else if (key == "contacts") {
+        model.contactsPerDay = static_cast<int>(value);
+    } else if (key == "mixing") {
+        model.mixingRate = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::vector<InterventionRule> parseInterventions(const std::string& text) {
+    std::vector<InterventionRule> rules;
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        std::string days;
+        if (!(fields >> days)) continue;
+
+        InterventionRule rule;
+        char dash = 0;
+        std::istringstream range(days);
+        bool valid = static_cast<bool>(range >> rule.firstDay);
+        if (valid && (range >> dash)) {
+            valid = dash == '-' && static_cast<bool>(range >> rule.lastDay);
+        } else {
+            rule.lastDay = rule.firstDay;
+        }
+        valid = valid && rule.firstDay >= 1 && rule.lastDay >= rule.firstDay;
+
+        std::string setting;
+        DiseaseModel probe;
+        while (valid && fields >> setting) {
+            std::size_t equals = setting.find('=');
+            std::string key = setting.substr(0, equals);
+            try {
+                double value = std::stod(setting.substr(equals + 1));
+                valid = equals != std::string::npos && applySetting(probe, key, value);
+                rule.settings.emplace_back(key, value);
+            } catch (const std::exception&) {
+                valid = false;
+            }
+        }
+
+        if (valid && !rule.settings.empty()) {
+            rules.push_back(rule);
+        } else {
+            std::cerr << "Warning: ignoring intervention rule \"" << line << "\".\n";
+        }
+    }
+    return rules;
+}
+
+std::vector<DiseaseModel> compileInterventions(const DiseaseModel& base, const std::vector<InterventionRule>& rules) {
+    int lastDay = 0;
+    for (const auto& rule : rules) {
+        lastDay = std::max(lastDay, rule.lastDay);
+    }
+
+    std::vector<DiseaseModel> days(rules.empty() ? 0 : lastDay + 1, base);
+    for (const auto& rule : rules) {
+        for (int day = rule.firstDay; day <= rule.lastDay; ++day) {
+            for (const auto& setting : rule.settings) {
+                applySetting(days[day], setting.first, setting.second);
+            }
+        }
+    }
+    return days;
+}
@@ -0,0 +1,25 @@
+#ifndef INTERVENTION_H
+#define INTERVENTION_H
+
+#include "disease_model.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+// One "start-end key=value ..." line of the [interventions] section: from day firstDay
+// to lastDay (inclusive) the listed parameters replace those of the disease model.
+// Keys: transmissibility, contacts (per day), mixing (inter-population contact rate).
+struct InterventionRule {
+    int firstDay;
+    int lastDay;
+    std::vector<std::pair<std::string, double>> settings;
+};
+
+// Parse newline-separated rules; malformed rules are reported and skipped
+std::vector<InterventionRule> parseInterventions(const std::string& text);
+
+// Dense table of the model in effect on days 0 .. last rule day, later rules overriding
+// earlier ones. Days past the end of the table use the base model.
+std::vector<DiseaseModel> compileInterventions(const DiseaseModel& base, const std::vector<InterventionRule>& rules);
+
+#endif // INTERVENTION_H
@@ -2,37 +2,101 @@
 
 #include "simulation.h"
 #include "INIReader.h"
+#include "config.h"
+#include "parallel.h"
+#include "sweep.h"
+#include "trace.h"
+#include "memory.h"
+#include "estimator.h"
 #include <iostream>
 #include <fstream>
+#include <random>
 
 int main(int argc, char* argv[]) {
     bool singlePopulationExperiment = false;
+    bool sweepMode = false;
     
-    // Check for single population experiment flag in the command line
+    // Check for single population experiment or sweep flag in the command line
     if (argc > 1 && std::string(argv[1]) == "--single-population") {
         singlePopulationExperiment = true;
     }
+    if (argc > 1 && std::string(argv[1]) == "--sweep") {
+        sweepMode = true;
+    }
+    bool timing = false;
+    bool perfCounters = false;
+    bool dryRun = false;
+    bool estimate = false;
+    std::string traceFilename;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--timing") {
+            timing = true;
+        }
+        if (std::string(argv[i]) == "--perf-counters") {
+            perfCounters = true;
+        }
+        if (std::string(argv[i]) == "--dry-run") {
+            dryRun = true;
+        }
+        if (std::string(argv[i]) == "--estimate") {
+            estimate = true;
+        }
+        if (std::string(argv[i]) == "--trace" && i + 1 < argc) {
+            traceFilename = argv[++i];
+        }
+    }
 
     if (singlePopulationExperiment) {
-        // Single Population Experiment parameters
-        std::string populationName = "SinglePopulation";
-        int populationSize = 15000;
-        double vaccinationRate = 0.1;   // No vaccinated individuals initially
-        int diseaseDuration = 3;            // Disease duration of 3 days
-        double transmissibility = 0.15; // Transmissibility of 0.15
+        // Single population experiment: [single_population] of the configuration file,
+        // overridden by --size, --vaccination-rate, --duration, --transmissibility, --runs
+        INIReader reader("disease_in.ini");
+        std::string populationName = reader.Get("single_population", "name", "SinglePopulation");
+        int populationSize = reader.GetInteger("single_population", "size", 15000);
+        double vaccinationRate = reader.GetReal("single_population", "vaccination_rate", 0.1);
+        DiseaseModel model = readDiseaseModel(reader);
+        int diseaseDuration = model.duration;
+        double transmissibility = model.transmissibility;
+        int runs = reader.GetInteger("single_population", "runs", 1);
+        std::string output = reader.Get("single_population", "output", "single_population_results.csv");
+        unsigned int randomSeed = reader.GetInteger("global", "random_seed", 0);
+
+        for (int i = 2; i + 1 < argc; ++i) {
+            std::string flag = argv[i];
+            if (flag == "--size") {
+                populationSize = std::stoi(argv[++i]);
+            } else if (flag == "--vaccination-rate") {
+                vaccinationRate = std::stod(argv[++i]);
+            } else if (flag == "--duration") {
+                diseaseDuration = std::stoi(argv[++i]);
+            } else if (flag == "--transmissibility") {
+                transmissibility = std::stod(argv[++i]);
+            } else if (flag == "--runs") {
+                runs = std::stoi(argv[++i]);
+            } else if (flag == "--seed") {
+                randomSeed = std::stoul(argv[++i]);
+            }
+        }
+        if (randomSeed != 0) {
+            seedRandomGenerator(randomSeed);
+        }
 
         // Initialize the single population
         Population singlePopulation(populationName, populationSize, vaccinationRate);
         singlePopulation.initializeInfection();  // Start with one infectious person
 
         // Initialize the simulation with only one population
-        std::vector<Population> populations = {singlePopulation};
-        Simulation sim(populations, diseaseDuration, transmissibility);
+        std::vector<Population> populations;
+        populations.push_back(std::move(singlePopulation));
+        model.duration = diseaseDuration;
+        model.setTransmissibility(transmissibility);
+        Simulation sim(std::move(populations), model);
+        sim.setInterventions(parseInterventions(reader.Get("interventions", "rule", "")));
+        sim.setDoubleBuffered(reader.GetBoolean("global", "double_buffered", false));
 
         // Start the simulation and record the results
-        sim.startSinglePopulationExperiment();
+        sim.startSinglePopulationExperiment(output, runs);
 
-        std::cout << "Single Population experiment completed. Results saved to 'single_population_results.csv'.\n";
+        std::cout << "Single Population experiment completed. Results saved to '" << output << "'.\n";
     } 
     
     else 
@@ -45,38 +109,118 @@ int main(int argc, char* argv[]) {
             return 1;
         }
 
-        int numPopulations = reader.GetInteger("global", "num_populations", 1);
-        int diseaseDuration = reader.GetInteger("disease", "duration", 3);
-        double transmissibility = reader.GetReal("disease", "transmissibility", 0.15);
+        DiseaseModel model = readDiseaseModel(reader);
         int simulationRuns = reader.GetInteger("global", "simulation_runs", 3); 
+        unsigned int randomSeed = reader.GetInteger("global", "random_seed", 0);
+        int branchDay = reader.GetInteger("global", "branch_day", 0);
+        int branchCount = reader.GetInteger("global", "branch_count", 0);
+        double targetHalfWidth = reader.GetReal("global", "target_half_width", 0.0);
 
+        if (randomSeed != 0) {
+            seedRandomGenerator(randomSeed);
+        }
 
-        std::vector<Population> populations;
-        for (int i = 1; i <= numPopulations; ++i) {
-            std::string section = "population_" + std::to_string(i);
-            std::string name = reader.Get(section, "name", "Unknown");
-            int size = reader.GetInteger(section, "size", 100);
-            double vaccinationRate = reader.GetReal(section, "vaccination_rate", 0.0);
+        if (dryRun) {
+            // Report the expected footprint without allocating any population
+            estimateMemory(reader).print(std::cout);
+            return 0;
+        }
+        if (estimate) {
+            // Memory plus a short calibration run projecting wall time and output volume
+            estimateRun(reader).print(std::cout);
+            return 0;
+        }
+
+        std::vector<PopulationSpec> specs = readPopulationSpecs(reader);
+        if (specs.empty()) {
+            std::cerr << "No populations configured.\n";
+            return 1;
+        }
 
-            Population pop(name, size, vaccinationRate);
-            pop.initializeInfection();  // Start with one infectious person
-            populations.push_back(pop);
+        if (sweepMode) {
+            // Parameter sweep over the [sweep] grid in a single process
+            ParameterSweep sweep = ParameterSweep::fromConfig(reader, specs);
+            int threads = resolveThreadCount(reader.GetInteger("sweep", "threads", 0));
+            std::cout << "Running sweep of " << sweep.getPoints().size() << " grid points x "
+                      << sweep.getReplicates() << " replicates on " << threads << " threads...\n";
+
+            unsigned int baseSeed = randomSeed != 0 ? randomSeed : std::random_device{}();
+            std::vector<SweepResult> results = sweep.run(threads, baseSeed);
+            ParameterSweep::writeResults(results, reader.Get("sweep", "output", "herdimm.csv"));
+            return 0;
+        }
+
+        bool keyedRandom = reader.GetBoolean("global", "keyed_random", false);
+        std::vector<Population> populations;
+        for (const auto& spec : specs) {
+            Population pop(spec.name, spec.size, spec.vaccinationRate, spec.ages);
+            pop.mobility = spec.mobility;
+            if (!keyedRandom) {
+                pop.initializeInfection();  // Start with one infectious person
+            }
+            populations.push_back(std::move(pop));
         }
 
         // Initialize the simulation with multiple populations
-        Simulation sim(populations, diseaseDuration, transmissibility);
+        Simulation sim(std::move(populations), model);
+        if (keyedRandom) {
+            // Draws keyed by (seed, population, person, day), as in disease_simulation_mpi
+            sim.useCommonRandomNumbers(randomSeed);
+            for (auto& pop : sim.populations) {
+                pop.initializeInfection();
+            }
+        }
+        sim.setInterventions(parseInterventions(reader.Get("interventions", "rule", "")));
+        sim.setDoubleBuffered(reader.GetBoolean("global", "double_buffered", false));
+        sim.setReplicateDetails(reader.GetBoolean("global", "replicate_details", false));
+        if (traceFilename.empty()) {
+            traceFilename = reader.Get("global", "trace", "");
+        }
+        if (!traceFilename.empty()) {
+            TraceRecorder::instance().enable(traceFilename); // Written when the program exits
+        }
+        if (timing || reader.GetBoolean("global", "timing", false)) {
+            sim.enableTiming(reader.Get("global", "timing_csv", ""));
+        }
+        if (perfCounters || reader.GetBoolean("global", "perf_counters", false)) {
+            if (!sim.enableHardwareCounters()) {
+                std::cerr << "Warning: hardware performance counters unavailable, reporting timings only.\n";
+            }
+        }
 
-         if (simulationRuns > 1) {
-    sim.runMultipleSimulations(simulationRuns);
+         if (branchDay > 0 && branchCount > 0) {
+    int failed = sim.runBranches(branchDay, branchCount, randomSeed, "disease_details");
+    if (failed > 0) {
+        std::cerr << failed << " scenario branches failed.\n";
+        return 1;
+    }
+    std::cout << "All " << branchCount << " scenario branches completed.\n";
+} else if (targetHalfWidth > 0.0) {
+    int threads = resolveThreadCount(reader.GetInteger("global", "threads", 1));
+    int batchSize = reader.GetInteger("global", "batch_size", 0);
+    int runs = sim.runAdaptiveSimulations(targetHalfWidth,
+                                          reader.GetReal("global", "confidence", 0.95),
+                                          simulationRuns,
+                                          reader.GetInteger("global", "max_runs", 1000),
+                                          batchSize > 0 ? batchSize : threads,
+                                          threads,
+                                          randomSeed != 0 ? randomSeed : std::random_device{}());
+    std::cout << runs << " adaptive simulation runs completed.\n";
+} else if (simulationRuns > 1) {
+    int threads = resolveThreadCount(reader.GetInteger("global", "threads", 1));
+    sim.runMultipleSimulations(simulationRuns, threads, randomSeed != 0 ? randomSeed : std::random_device{}());
 
     std::cout << "Multiple simulation runs completed.\n";
 } else {
      std::string detailsFilename = "disease_details.csv";
     std::string statsFilename = "disease_stats.csv";
+    sim.setThreads(resolveThreadCount(reader.GetInteger("global", "threads", 1)));
     sim.start(detailsFilename);
     sim.writeSummaryStatistics(statsFilename);
 }
 
+        MemoryAccounting::printReport(std::cout);
+
     }
     return 0;
 }
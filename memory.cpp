@@ -0,0 +1,131 @@
+#include "memory.h"
+#include "config.h"
+#include "parallel.h"
+#include "simulation.h"
+#include "stats.h"
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+
+static std::atomic<std::size_t> currentBytes[memoryCategoryCount];
+static std::atomic<std::size_t> peakBytes[memoryCategoryCount];
+static std::atomic<std::size_t> currentAll(0);
+static std::atomic<std::size_t> peakAll(0);
+
+const char* memoryCategoryName(MemoryCategory category) {
+    switch (category) {
+        case MemoryCategory::PopulationState: return "population_state";
+        case MemoryCategory::Scratch: return "scratch";
+        case MemoryCategory::Statistics: return "statistics";
+        case MemoryCategory::OutputBuffers: return "output_buffers";
+    }
+    return "unknown";
+}
+
+static void raisePeak(std::atomic<std::size_t>& peak, std::size_t value) {
+    std::size_t previous = peak.load(std::memory_order_relaxed);
+    while (value > previous && !peak.compare_exchange_weak(previous, value, std::memory_order_relaxed)) {
+    }
+}
+
+void MemoryAccounting::allocate(MemoryCategory category, std::size_t bytes) {
+    int c = static_cast<int>(category);
+    raisePeak(peakBytes[c], currentBytes[c].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    raisePeak(peakAll, currentAll.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+void MemoryAccounting::release(MemoryCategory category, std::size_t bytes) {
+    currentBytes[static_cast<int>(category)].fetch_sub(bytes, std::memory_order_relaxed);
+    currentAll.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+std::size_t MemoryAccounting::current(MemoryCategory category) {
+    return currentBytes[static_cast<int>(category)].load(std::memory_order_relaxed);
+}
+
+std::size_t MemoryAccounting::peak(MemoryCategory category) {
+    return peakBytes[static_cast<int>(category)].load(std::memory_order_relaxed);
+}
+
+std::size_t MemoryAccounting::currentTotal() {
+    return currentAll.load(std::memory_order_relaxed);
+}
+
+std::size_t MemoryAccounting::peakTotal() {
+    return peakAll.load(std::memory_order_relaxed);
+}
+
+static void printBytesRow(std::ostream& out, const char* name, std::size_t first, std::size_t second) {
+    out << std::left << std::setw(17) << name << "| "
+        << std::setw(14) << std::fixed << std::setprecision(2) << first / 1048576.0 << "| "
+        << second / 1048576.0 << "\n";
+}
+
+void MemoryAccounting::printReport(std::ostream& out) {
+    out << "\nMemory Usage by Subsystem:\n";
+    out << "--------------------------------------------------\n";
+    out << "Subsystem        | Current [MiB] | Peak [MiB]\n";
+    out << "--------------------------------------------------\n";
+    for (int c = 0; c < memoryCategoryCount; ++c) {
+        printBytesRow(out, memoryCategoryName(static_cast<MemoryCategory>(c)),
+                      current(static_cast<MemoryCategory>(c)), peak(static_cast<MemoryCategory>(c)));
+    }
+    printBytesRow(out, "total", currentTotal(), peakTotal());
+    out << "--------------------------------------------------\n";
+    out << std::defaultfloat << std::right;
+}
+
+std::size_t MemoryEstimate::total() const {
+    std::size_t sum = 0;
+    for (std::size_t value : bytes) sum += value;
+    return sum;
+}
+
+void MemoryEstimate::print(std::ostream& out) const {
+    out << "\nEstimated Memory (nothing allocated):\n";
+    out << "--------------------------------------------------\n";
+    out << "Subsystem        | Peak [MiB]\n";
+    out << "--------------------------------------------------\n";
+    for (int c = 0; c < memoryCategoryCount; ++c) {
+        out << std::left << std::setw(17) << memoryCategoryName(static_cast<MemoryCategory>(c)) << "| "
+            << std::fixed << std::setprecision(2) << bytes[c] / 1048576.0 << "\n";
+    }
+    out << std::left << std::setw(17) << "total" << "| " << total() / 1048576.0 << "\n";
+    out << "--------------------------------------------------\n";
+    out << std::defaultfloat << std::right;
+}
+
+MemoryEstimate estimateMemory(const INIReader& reader, int assumedDays) {
+    std::vector<PopulationSpec> specs = readPopulationSpecs(reader);
+    int runs = reader.GetInteger("global", "simulation_runs", 3);
+    int threads = resolveThreadCount(reader.GetInteger("global", "threads", 1));
+
+    std::size_t people = 0, agedPeople = 0;
+    for (const auto& spec : specs) {
+        people += spec.size;
+        agedPeople += spec.ages.empty() ? 0 : spec.size;
+    }
+
+    // One live copy, plus the initial state kept for repeated runs and one copy per replicate thread;
+    // double-buffered live copies hold a second state array
+    std::size_t liveCopies = 1 + (runs > 1 && threads > 1 ? threads : 0);
+    std::size_t copies = liveCopies + (runs > 1 ? 1 : 0);
+    bool doubleBuffered = reader.GetBoolean("global", "double_buffered", false);
+    std::size_t personCopies = copies + (doubleBuffered ? liveCopies : 0);
+    int workers = runs > 1 ? std::min(threads, runs) : 1;
+
+    MemoryEstimate estimate;
+    estimate.bytes[static_cast<int>(MemoryCategory::PopulationState)] = personCopies * people * sizeof(Person) + copies * agedPeople * sizeof(std::uint8_t);
+    // One bit per person marking the day's new infections, allocated with every population copy
+    estimate.bytes[static_cast<int>(MemoryCategory::Scratch)] = copies * ((people + 63) / 64 + specs.size()) * sizeof(std::uint64_t);
+    if (runs > 1) {
+        // Per population, compartment and day: moments plus a sketch holding one value
+        // per run until it starts compacting at roughly 3k values (k = 128)
+        std::size_t sketchValues = std::min<std::size_t>(runs, 3 * 128);
+        std::size_t cellBytes = sizeof(RunningStatistics) + sizeof(QuantileSketch) + sketchValues * sizeof(float);
+        estimate.bytes[static_cast<int>(MemoryCategory::Statistics)] =
+            (workers + 1) * static_cast<std::size_t>(assumedDays) * specs.size() * compartmentCount * cellBytes;
+    }
+    estimate.bytes[static_cast<int>(MemoryCategory::OutputBuffers)] = workers * outputBufferSize;
+    return estimate;
+}
@@ -0,0 +1,80 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <cstddef>
+#include <new>
+#include <ostream>
+#include <vector>
+
+class INIReader;
+
+// Subsystems that memory is attributed to
+enum class MemoryCategory { PopulationState, Scratch, Statistics, OutputBuffers };
+constexpr int memoryCategoryCount = 4;
+const char* memoryCategoryName(MemoryCategory category);
+
+// Process-wide current and peak bytes per category, updated by TrackingAllocator
+class MemoryAccounting {
+public:
+    static void allocate(MemoryCategory category, std::size_t bytes);
+    static void release(MemoryCategory category, std::size_t bytes);
+
+    static std::size_t current(MemoryCategory category);
+    static std::size_t peak(MemoryCategory category);
+    static std::size_t currentTotal();
+    static std::size_t peakTotal();
+
+    static void printReport(std::ostream& out);
+};
+
+// Standard allocator that books every allocation to one category
+template <typename T, MemoryCategory Category>
+class TrackingAllocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = TrackingAllocator<U, Category>;
+    };
+
+    TrackingAllocator() noexcept = default;
+    template <typename U>
+    TrackingAllocator(const TrackingAllocator<U, Category>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        T* memory = static_cast<T*>(::operator new(n * sizeof(T)));
+        MemoryAccounting::allocate(Category, n * sizeof(T));
+        return memory;
+    }
+
+    void deallocate(T* memory, std::size_t n) noexcept {
+        MemoryAccounting::release(Category, n * sizeof(T));
+        ::operator delete(memory);
+    }
+
+    template <typename U>
+    bool operator==(const TrackingAllocator<U, Category>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const TrackingAllocator<U, Category>&) const noexcept { return false; }
+};
+
+template <typename T, MemoryCategory Category>
+using TrackedVector = std::vector<T, TrackingAllocator<T, Category>>;
+
+// Size of the buffer given to each CSV output stream
+constexpr std::size_t outputBufferSize = 1 << 16;
+
+// Expected footprint of a configuration, computed without allocating the populations
+struct MemoryEstimate {
+    std::size_t bytes[memoryCategoryCount] = {};
+    std::size_t total() const;
+    void print(std::ostream& out) const;
+};
+
+// Estimate from disease_in.ini: population state (including the copies kept for
+// repeated runs and per worker thread), worst-case scratch, ensemble statistics for
+// assumedDays days and the output buffers
+MemoryEstimate estimateMemory(const INIReader& reader, int assumedDays = 365);
+
+#endif // MEMORY_H
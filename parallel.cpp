@@ -0,0 +1,195 @@
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+int resolveThreadCount(int requestedThreads) {
+    if (requestedThreads > 0) {
+        return requestedThreads;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void parallelFor(int taskCount, int threadCount, const std::function<void(int, int)>& task) {
+    threadCount = std::max(1, std::min(threadCount, taskCount));
+    std::atomic<int> nextTask(0);
+
+    auto worker = [&](int workerIndex) {
+        for (int t = nextTask.fetch_add(1); t < taskCount; t = nextTask.fetch_add(1)) {
+            task(t, workerIndex);
+        }
+    };
+
+    // The calling thread works as worker 0
+    std::vector<std::thread> threads;
+    for (int w = 1; w < threadCount; ++w) {
+        threads.emplace_back(worker, w);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+std::vector<int> balanceByCost(const std::vector<double>& costs, int binCount) {
+    std::vector<int> order(costs.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = static_cast<int>(i);
+    std::stable_sort(order.begin(), order.end(), [&costs](int a, int b) { return costs[a] > costs[b]; });
+
+    std::vector<double> load(std::max(1, binCount), 0.0);
+    std::vector<int> bins(costs.size(), 0);
+    for (int item : order) {
+        int bin = static_cast<int>(std::min_element(load.begin(), load.end()) - load.begin());
+        bins[item] = bin;
+        load[bin] += costs[item];
+    }
+    return bins;
+}
+
+// Tasks dealt to per-worker queues by balanceByCost, every queue most expensive first
+class StealingQueues {
+public:
+    StealingQueues(const std::vector<double>& costs, int workers) : queues(workers) {
+        std::vector<int> owners = balanceByCost(costs, workers);
+        std::vector<int> order(costs.size());
+        for (size_t t = 0; t < order.size(); ++t) order[t] = static_cast<int>(t);
+        std::stable_sort(order.begin(), order.end(), [&costs](int a, int b) { return costs[a] > costs[b]; });
+        for (int t : order) {
+            queues[owners[t]].tasks.push_back(t);
+        }
+    }
+
+    // The worker's next task: the front of its own queue, otherwise stolen from the cheap end
+    // of another; -1 once every queue is drained (no task is ever added)
+    int next(int workerIndex) {
+        int workers = queues.size();
+        {
+            TaskQueue& own = queues[workerIndex];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                int t = own.tasks.front();
+                own.tasks.pop_front();
+                return t;
+            }
+        }
+        for (int k = 1; k < workers; ++k) {
+            TaskQueue& victim = queues[(workerIndex + k) % workers];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                int t = victim.tasks.back();
+                victim.tasks.pop_back();
+                return t;
+            }
+        }
+        return -1;
+    }
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+    std::vector<TaskQueue> queues;
+};
+
+void parallelForStealing(const std::vector<double>& costs, int threadCount,
+                         const std::function<void(int, int)>& task) {
+    int taskCount = costs.size();
+    threadCount = std::max(1, std::min(threadCount, taskCount));
+    if (threadCount == 1) {
+        for (int t = 0; t < taskCount; ++t) {
+            task(t, 0);
+        }
+        return;
+    }
+
+    StealingQueues queues(costs, threadCount);
+    auto worker = [&](int workerIndex) {
+        for (int t = queues.next(workerIndex); t >= 0; t = queues.next(workerIndex)) {
+            task(t, workerIndex);
+        }
+    };
+
+    // The calling thread works as worker 0
+    std::vector<std::thread> threads;
+    for (int w = 1; w < threadCount; ++w) {
+        threads.emplace_back(worker, w);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+WorkerPool::WorkerPool(int threadCount) : threadCount(std::max(1, threadCount)) {
+    for (int w = 1; w < this->threadCount; ++w) {
+        threads.emplace_back(&WorkerPool::workerLoop, this, w);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::run(const std::function<void(int)>& body) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &body;
+        busy = threadCount - 1;
+        generation++;
+    }
+    wake.notify_all();
+    body(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return busy == 0; });
+    job = nullptr;
+}
+
+void WorkerPool::workerLoop(int workerIndex) {
+    std::uint64_t seen = 0;
+    for (;;) {
+        const std::function<void(int)>* body;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            body = job;
+        }
+        (*body)(workerIndex);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0) {
+            finished.notify_one();
+        }
+    }
+}
+
+void WorkerPool::runStealing(const std::vector<double>& costs, const std::function<void(int, int)>& task) {
+    int taskCount = costs.size();
+    int workers = std::max(1, std::min(threadCount, taskCount));
+    if (workers == 1) {
+        for (int t = 0; t < taskCount; ++t) {
+            task(t, 0);
+        }
+        return;
+    }
+
+    // Pool threads beyond the task count have nothing to do in this loop
+    StealingQueues queues(costs, workers);
+    run([&](int workerIndex) {
+        if (workerIndex >= workers) return;
+        for (int t = queues.next(workerIndex); t >= 0; t = queues.next(workerIndex)) {
+            task(t, workerIndex);
+        }
+    });
+}
@@ -0,0 +1,59 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use when the configuration asks for 0 (all hardware threads)
+int resolveThreadCount(int requestedThreads);
+
+// Run task(taskIndex, workerIndex) for every task in [0, taskCount) on threadCount
+// worker threads. Tasks are handed out dynamically, so uneven task costs balance out.
+void parallelFor(int taskCount, int threadCount, const std::function<void(int, int)>& task);
+
+// Run task(taskIndex, workerIndex) for every task with an estimated cost on threadCount
+// worker threads with work stealing: the tasks are dealt to per-worker queues by
+// balanceByCost, each worker runs its own queue most expensive first and, once it is
+// empty, steals from the cheap end of the other queues.
+void parallelForStealing(const std::vector<double>& costs, int threadCount,
+                         const std::function<void(int, int)>& task);
+
+// Worker threads kept for many parallel loops, so a simulated day doesn't start and join
+// threads for every phase. The calling thread works as worker 0 of every loop.
+class WorkerPool {
+public:
+    explicit WorkerPool(int threadCount);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int size() const { return threadCount; }
+
+    // parallelForStealing on the pool's threads
+    void runStealing(const std::vector<double>& costs, const std::function<void(int, int)>& task);
+
+private:
+    int threadCount;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;     // A loop started or the pool stops
+    std::condition_variable finished; // The last worker left the loop
+    const std::function<void(int)>* job = nullptr; // Body of the current loop, called with the worker index
+    std::uint64_t generation = 0;     // Loops started so far
+    int busy = 0;                     // Pool threads still in the current loop
+    bool stopping = false;
+
+    // Run job(workerIndex) on every worker and return when all are done
+    void run(const std::function<void(int)>& job);
+    void workerLoop(int workerIndex);
+};
+
+// Assign items of the given costs to binCount bins, largest first onto the least loaded
+// bin (ties go to the lower index), and return the bin of every item
+std::vector<int> balanceByCost(const std::vector<double>& costs, int binCount);
+
+#endif // PARALLEL_H
@@ -0,0 +1,108 @@
+#include "perf_counters.h"
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char* counterName(Counter counter) {
+    switch (counter) {
+        case Counter::Cycles: return "cycles";
+        case Counter::Instructions: return "instructions";
+        case Counter::LlcMisses: return "llc_misses";
+        case Counter::BranchMisses: return "branch_misses";
+        case Counter::DtlbMisses: return "dtlb_misses";
+    }
+    return "unknown";
+}
+
+#ifdef __linux__
+static int openEvent(std::uint32_t type, std::uint64_t config, int groupLeader) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = groupLeader < 0 ? 1 : 0;   // The leader starts the whole group
+    attr.exclude_kernel = 1;                   // Allowed with the default perf_event_paranoid
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, groupLeader, 0));
+}
+#endif
+
+PerfCounters::PerfCounters() {
+    descriptors.fill(-1);
+    slots.fill(-1);
+
+#ifdef __linux__
+    const std::uint32_t types[counterCount] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                               PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE};
+    const std::uint64_t configs[counterCount] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+
+    for (int c = 0; c < counterCount; ++c) {
+        int fd = openEvent(types[c], configs[c], leader);
+        if (fd < 0) {
+            if (error.empty()) {
+                error = std::string(counterName(static_cast<Counter>(c))) + ": " + std::strerror(errno);
+            }
+            continue;
+        }
+        if (leader < 0) {
+            leader = fd;
+        }
+        descriptors[c] = fd;
+        slots[c] = opened++;
+    }
+
+    if (leader >= 0) {
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#else
+    error = "perf_event_open is only available on Linux";
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (int fd : descriptors) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+CounterValues PerfCounters::read() const {
+    CounterValues values{};
+#ifdef __linux__
+    if (leader < 0) {
+        return values;
+    }
+
+    // Group read layout: nr, time_enabled, time_running, value[nr]
+    std::uint64_t buffer[3 + counterCount];
+    ssize_t expected = static_cast<ssize_t>((3 + opened) * sizeof(std::uint64_t));
+    if (::read(leader, buffer, sizeof(buffer)) < expected) {
+        return values;
+    }
+
+    // Scale up when the kernel had to multiplex the group with other events
+    double scale = buffer[2] > 0 ? static_cast<double>(buffer[1]) / buffer[2] : 1.0;
+    for (int c = 0; c < counterCount; ++c) {
+        if (slots[c] >= 0) {
+            values[c] = static_cast<std::uint64_t>(buffer[3 + slots[c]] * scale);
+        }
+    }
+#endif
+    return values;
+}
@@ -0,0 +1,40 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Hardware events read around the phases of the simulated day
+enum class Counter { Cycles, Instructions, LlcMisses, BranchMisses, DtlbMisses };
+constexpr int counterCount = 5;
+const char* counterName(Counter counter);
+
+using CounterValues = std::array<std::uint64_t, counterCount>;
+
+// Linux perf_event_open counters for the calling thread, opened as one group so a
+// single read() returns all of them. Events the kernel or container refuses are
+// left out; if none can be opened the counters report as unavailable.
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool isAvailable() const { return leader >= 0; }
+    bool isAvailable(Counter counter) const { return slots[static_cast<int>(counter)] >= 0; }
+    const std::string& errorMessage() const { return error; }
+
+    // Cumulative values since opening, scaled for multiplexing; unavailable events read 0
+    CounterValues read() const;
+
+private:
+    int leader = -1;                               // Group leader file descriptor
+    std::array<int, counterCount> descriptors;     // -1 when the event could not be opened
+    std::array<int, counterCount> slots;           // Position of the event in a group read
+    int opened = 0;
+    std::string error;
+};
+
+#endif // PERF_COUNTERS_H
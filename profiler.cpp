@@ -0,0 +1,160 @@
+#include "profiler.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+const char* phaseName(Phase phase) {
+    switch (phase) {
+        case Phase::Infection: return "infection";
+        case Phase::Recovery: return "recovery";
+        case Phase::Counting: return "counting";
+        case Phase::CsvWrite: return "csv_write";
+        case Phase::InterPopulation: return "inter_population";
+    }
+    return "unknown";
+}
+
+void PhaseProfile::beginDay(int day) {
+    currentDay = day;
+    if (enabled && day > dayCount()) {
+        daily.resize(day, DayTimes{});
+    }
+}
+
+void PhaseProfile::add(Phase phase, std::uint64_t nanoseconds) {
+    if (currentDay > 0 && currentDay <= dayCount()) {
+        daily[currentDay - 1][static_cast<int>(phase)] += nanoseconds;
+    }
+}
+
+bool PhaseProfile::enableHardwareCounters() {
+    counterRequest = true;
+    auto opened = std::make_shared<PerfCounters>();
+    if (!opened->isAvailable()) {
+        counterError = opened->errorMessage();
+        return false;
+    }
+    counters = opened;
+    return true;
+}
+
+void PhaseProfile::addCounters(Phase phase, const CounterValues& begin, const CounterValues& end) {
+    CounterValues& totals = counterTotals[static_cast<int>(phase)];
+    for (int c = 0; c < counterCount; ++c) {
+        totals[c] += end[c] - begin[c];
+    }
+}
+
+void PhaseProfile::merge(const PhaseProfile& other) {
+    for (int p = 0; p < phaseCount; ++p) {
+        for (int c = 0; c < counterCount; ++c) {
+            counterTotals[p][c] += other.counterTotals[p][c];
+        }
+    }
+    if (!other.counterError.empty() && counterError.empty()) {
+        counterError = other.counterError;
+    }
+
+    if (other.dayCount() > dayCount()) {
+        daily.resize(other.dayCount(), DayTimes{});
+    }
+    for (int d = 0; d < other.dayCount(); ++d) {
+        for (int p = 0; p < phaseCount; ++p) {
+            daily[d][p] += other.daily[d][p];
+        }
+    }
+}
+
+std::uint64_t PhaseProfile::total(Phase phase) const {
+    std::uint64_t sum = 0;
+    for (const auto& day : daily) {
+        sum += day[static_cast<int>(phase)];
+    }
+    return sum;
+}
+
+void PhaseProfile::printSummary(std::ostream& out) const {
+    std::uint64_t all = 0;
+    for (int p = 0; p < phaseCount; ++p) {
+        all += total(static_cast<Phase>(p));
+    }
+
+    out << "\nPhase Timing (" << dayCount() << " days):\n";
+    out << "--------------------------------------------------------------\n";
+    out << "Phase            | Total [ms]    | Per day [us]  | Share\n";
+    out << "--------------------------------------------------------------\n";
+    for (int p = 0; p < phaseCount; ++p) {
+        std::uint64_t nanoseconds = total(static_cast<Phase>(p));
+        out << std::left << std::setw(17) << phaseName(static_cast<Phase>(p)) << "| "
+            << std::setw(14) << std::fixed << std::setprecision(3) << nanoseconds / 1e6 << "| "
+            << std::setw(14) << (dayCount() > 0 ? nanoseconds / 1e3 / dayCount() : 0.0) << "| "
+            << std::setprecision(1) << (all > 0 ? 100.0 * nanoseconds / all : 0.0) << "%\n";
+    }
+    out << "--------------------------------------------------------------\n";
+    out << std::defaultfloat << std::right;
+}
+
+void PhaseProfile::printCounterSummary(std::ostream& out, std::uint64_t personDays) const {
+    if (!counterRequest) {
+        return;
+    }
+
+    bool anyCounts = false;
+    for (const auto& totals : counterTotals) {
+        for (std::uint64_t value : totals) {
+            anyCounts = anyCounts || value > 0;
+        }
+    }
+    if (!anyCounts) {
+        out << "\nHardware counters unavailable"
+            << (counterError.empty() ? "" : " (" + counterError + ")")
+            << "; only timings were recorded.\n";
+        return;
+    }
+
+    double perPersonDay = personDays > 0 ? 1.0 / personDays : 0.0;
+    out << "\nHardware Counters per Person-Day (" << personDays << " person-days):\n";
+    out << "------------------------------------------------------------------------------------------\n";
+    out << std::left << std::setw(17) << "Phase";
+    for (int c = 0; c < counterCount; ++c) {
+        out << "| " << std::setw(14) << counterName(static_cast<Counter>(c));
+    }
+    out << "| IPC\n";
+    out << "------------------------------------------------------------------------------------------\n";
+    for (int p = 0; p < phaseCount; ++p) {
+        const CounterValues& totals = counterTotals[p];
+        out << std::left << std::setw(17) << phaseName(static_cast<Phase>(p));
+        for (int c = 0; c < counterCount; ++c) {
+            out << "| " << std::setw(14) << std::fixed << std::setprecision(3) << totals[c] * perPersonDay;
+        }
+        std::uint64_t cycles = totals[static_cast<int>(Counter::Cycles)];
+        out << "| " << std::setprecision(2)
+            << (cycles > 0 ? static_cast<double>(totals[static_cast<int>(Counter::Instructions)]) / cycles : 0.0) << "\n";
+    }
+    out << "------------------------------------------------------------------------------------------\n";
+    if (!counterError.empty()) {
+        out << "Some events were unavailable (" << counterError << ") and read as 0.\n";
+    }
+    out << std::defaultfloat << std::right;
+}
+
+void PhaseProfile::writeDailyCsv(const std::string& filename) const {
+    std::ofstream csv(filename);
+    if (!csv.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << " for writing phase timings.\n";
+        return;
+    }
+
+    csv << "Day";
+    for (int p = 0; p < phaseCount; ++p) {
+        csv << "," << phaseName(static_cast<Phase>(p)) << "_ns";
+    }
+    csv << "\n";
+    for (int d = 0; d < dayCount(); ++d) {
+        csv << d + 1;
+        for (int p = 0; p < phaseCount; ++p) {
+            csv << "," << daily[d][p];
+        }
+        csv << "\n";
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "perf_counters.h"
+
+// Phases of one simulated day
+enum class Phase { Infection, Recovery, Counting, CsvWrite, InterPopulation };
+constexpr int phaseCount = 5;
+const char* phaseName(Phase phase);
+
+// Wall time per phase and day. Disabled profiles record nothing, so the
+// timers can stay compiled into the day loop.
+class PhaseProfile {
+public:
+    void setEnabled(bool enabled) { this->enabled = enabled; }
+    bool isEnabled() const { return enabled; }
+
+    // Following add() calls are attributed to this day (1-based)
+    void beginDay(int day);
+    void add(Phase phase, std::uint64_t nanoseconds);
+
+    // Also read hardware counters around every phase on the calling thread.
+    // Returns false (and keeps timing only) when the counters cannot be opened.
+    bool enableHardwareCounters();
+    bool countersRequested() const { return counterRequest; }
+    bool hasCounters() const { return counters != nullptr; }
+    CounterValues readCounters() const { return counters->read(); }
+    void addCounters(Phase phase, const CounterValues& begin, const CounterValues& end);
+
+    // Add another profile day by day (e.g. from replicates run on other threads)
+    void merge(const PhaseProfile& other);
+
+    int dayCount() const { return static_cast<int>(daily.size()); }
+    std::uint64_t total(Phase phase) const;
+
+    void printSummary(std::ostream& out) const;
+    // Counter totals per phase, normalised by the simulated person-days
+    void printCounterSummary(std::ostream& out, std::uint64_t personDays) const;
+    // Day,<phase>_ns,... one row per day
+    void writeDailyCsv(const std::string& filename) const;
+
+private:
+    using DayTimes = std::array<std::uint64_t, phaseCount>;
+
+    bool enabled = false;
+    int currentDay = 0;
+    std::vector<DayTimes> daily;
+
+    bool counterRequest = false;
+    std::string counterError;
+    std::shared_ptr<PerfCounters> counters;           // Bound to the thread that enabled them
+    std::array<CounterValues, phaseCount> counterTotals{};
+};
+
+// Adds the lifetime of the scope to one phase of the profile
+class ScopedPhase {
+public:
+    ScopedPhase(PhaseProfile& profile, Phase phase)
+        : profile(profile.isEnabled() ? &profile : nullptr), phase(phase) {
+        if (this->profile) {
+            if (this->profile->hasCounters()) {
+                beginCounts = this->profile->readCounters();
+            }
+            begin = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedPhase() {
+        if (profile) {
+            auto elapsed = std::chrono::steady_clock::now() - begin;
+            profile->add(phase, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            if (profile->hasCounters()) {
+                profile->addCounters(phase, beginCounts, profile->readCounters());
+            }
+        }
+    }
+
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+private:
+    PhaseProfile* profile;
+    Phase phase;
+    std::chrono::steady_clock::time_point begin;
+    CounterValues beginCounts{};
+};
+
+#endif // PROFILER_H
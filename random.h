@@ -0,0 +1,64 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// Counter-based random numbers for common-random-numbers experiments.
+// A draw is a pure function of its key, so runs with different parameters
+// that ask for the same (stream, person, day, slot) get the same value.
+
+// SplitMix64 finalizer, a fast bijective bit mixer
+inline std::uint64_t mixBits(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Combine two keys into one stream identifier
+inline std::uint64_t combineKeys(std::uint64_t a, std::uint64_t b) {
+    return mixBits(a ^ mixBits(b + 0x9e3779b97f4a7c15ULL));
+}
+
+// 64 random bits keyed by (stream, person, day, slot)
+inline std::uint64_t keyedRandom(std::uint64_t stream, std::uint64_t person, std::uint64_t day, std::uint64_t slot) {
+    std::uint64_t h = mixBits(stream + 0x9e3779b97f4a7c15ULL * (person + 1));
+    h = mixBits(h ^ (day << 32 | (slot & 0xffffffffULL)));
+    return h;
+}
+
+// Map random bits to [0, n) without division (Lemire's multiply-shift)
+inline int randomBelow(std::uint64_t bits, int n) {
+    return static_cast<int>(((bits >> 32) * static_cast<std::uint64_t>(n)) >> 32);
+}
+
+// Probability p as a 16-bit binary fraction, 0x10000 meaning certainty
+inline std::uint32_t probabilityBits(double p) {
+    if (p <= 0.0) return 0;
+    if (p >= 1.0) return 0x10000;
+    return static_cast<std::uint32_t>(p * 65536.0 + 0.5);
+}
+
+// 64 independent Bernoulli(p) bits from at most 16 random words: walking the binary
+// expansion of p from its lowest set digit, a 1 digit ORs in a fresh word and a 0
+// digit ANDs one in, which halves or raises the probability of every bit at once
+template <typename NextWord>
+inline std::uint64_t bernoulliWord(std::uint32_t pBits, NextWord&& nextWord) {
+    if (pBits >= 0x10000) return ~0ULL;
+    if (pBits == 0) return 0;
+    std::uint64_t mask = 0;
+    for (int digit = __builtin_ctz(pBits); digit < 16; ++digit) {
+        std::uint64_t word = nextWord();
+        mask = (pBits >> digit & 1) ? (mask | word) : (mask & word);
+    }
+    return mask;
+}
+
+// One Bernoulli(p) decision from random bits, at the resolution of probabilityBits
+inline bool bernoulliDraw(std::uint64_t bits, std::uint32_t pBits) {
+    return (bits & 0xffff) < pBits;
+}
+
+#endif // RANDOM_H
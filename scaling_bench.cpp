@@ -0,0 +1,257 @@
+#include "simulation.h"
+#include "config.h"
+#include "INIReader.h"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// End-to-end scaling benchmark. Generates synthetic disease_in.ini configurations,
+// runs the full runMultipleSimulations pipeline at 1..N threads (each measurement in
+// its own child process so peak RSS is per measurement) and writes strong- and
+// weak-scaling results as JSON. With --baseline the throughput is compared against
+// a stored report and the exit code is 2 if any configuration regressed.
+//
+// Usage: disease_scaling [--max-threads N] [--populations N] [--population-size N]
+//                        [--runs N] [--output FILE] [--baseline FILE] [--tolerance F]
+
+namespace fs = std::filesystem;
+
+struct ScalingOptions {
+    int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    int populations = 8;          // Populations per synthetic configuration
+    int populationSize = 20000;   // Mean population size
+    int runs = 8;                 // Replicates for strong scaling, per thread for weak scaling
+    std::string output = "scaling.json";
+    std::string baseline;         // Previous report to compare against
+    double tolerance = 0.10;      // Allowed throughput loss before flagging a regression
+};
+
+struct ScalingResult {
+    std::string name;
+    std::string mode;
+    int threads = 0;
+    int runs = 0;
+    double wallSeconds = 0.0;
+    double personDays = 0.0;
+    long peakRssKb = 0;
+    std::uintmax_t outputBytes = 0;
+
+    double personDaysPerSecond() const { return wallSeconds > 0.0 ? personDays / wallSeconds : 0.0; }
+};
+
+// Synthetic configuration: sizes alternate around the mean, vaccination rates 0..40%
+static void writeSyntheticConfig(const std::string& filename, const ScalingOptions& options, int runs) {
+    std::ofstream config(filename);
+    config << "[global]\n"
+           << "simulation_name = scaling\n"
+           << "num_populations = " << options.populations << "\n"
+           << "simulation_runs = " << runs << "\n\n"
+           << "[disease]\n"
+           << "duration = 3\n"
+           << "transmissibility = 0.15\n";
+    for (int i = 1; i <= options.populations; ++i) {
+        config << "\n[population_" << i << "]\n"
+               << "name = Synthetic" << i << "\n"
+               << "size = " << options.populationSize / 2 + (i % 3) * options.populationSize / 2 << "\n"
+               << "vaccination_rate = " << (i % 5) * 0.1 << "\n";
+    }
+}
+
+static std::uintmax_t directoryBytes(const fs::path& directory) {
+    std::uintmax_t bytes = 0;
+    for (const auto& entry : fs::directory_iterator(directory)) {
+        if (entry.is_regular_file() && entry.path().filename() != "disease_in.ini") {
+            bytes += entry.file_size();
+        }
+    }
+    return bytes;
+}
+
+// Run one configuration in a child process working in its own scratch directory
+static bool measure(const ScalingOptions& options, ScalingResult& result) {
+    fs::path workDirectory = fs::current_path() / ("scaling_work_" + result.mode + "_" + std::to_string(result.threads));
+    fs::remove_all(workDirectory);
+    fs::create_directories(workDirectory);
+
+    int channel[2];
+    if (pipe(channel) != 0) {
+        return false;
+    }
+    std::cout.flush();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+
+    if (pid == 0) {
+        close(channel[0]);
+        fs::current_path(workDirectory);
+        writeSyntheticConfig("disease_in.ini", options, result.runs);
+
+        auto begin = std::chrono::steady_clock::now();
+        INIReader reader("disease_in.ini");
+        std::vector<Population> populations;
+        for (const auto& spec : readPopulationSpecs(reader)) {
+            populations.emplace_back(spec.name, spec.size, spec.vaccinationRate);
+            populations.back().initializeInfection();
+        }
+        Simulation sim(std::move(populations), readDiseaseModel(reader));
+
+        // The pipeline reports progress on stdout; keep it out of the benchmark output
+        std::ofstream devNull("/dev/null");
+        std::streambuf* console = std::cout.rdbuf(devNull.rdbuf());
+        sim.runMultipleSimulations(result.runs, result.threads, 12345);
+        std::cout.rdbuf(console);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        std::ostringstream report;
+        report << std::setprecision(17) << seconds << " " << static_cast<double>(sim.getPersonDays()) << " "
+               << directoryBytes(".") << "\n";
+        std::string text = report.str();
+        bool written = write(channel[1], text.data(), text.size()) == static_cast<ssize_t>(text.size());
+        close(channel[1]);
+        _exit(written ? 0 : 1);
+    }
+
+    close(channel[1]);
+    std::string text;
+    char buffer[256];
+    for (ssize_t n; (n = read(channel[0], buffer, sizeof(buffer))) > 0;) {
+        text.append(buffer, n);
+    }
+    close(channel[0]);
+
+    int status = 0;
+    struct rusage usage {};
+    wait4(pid, &status, 0, &usage);
+    fs::remove_all(workDirectory);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return false;
+    }
+
+    std::istringstream report(text);
+    report >> result.wallSeconds >> result.personDays >> result.outputBytes;
+    result.peakRssKb = usage.ru_maxrss; // Kilobytes on Linux
+    return static_cast<bool>(report);
+}
+
+static void writeReport(const std::string& filename, const ScalingOptions& options, const std::vector<ScalingResult>& results) {
+    std::ofstream json(filename);
+    json << "{\n"
+         << "  \"benchmark\": \"disease_scaling\",\n"
+         << "  \"populations\": " << options.populations << ",\n"
+         << "  \"population_size\": " << options.populationSize << ",\n"
+         << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const ScalingResult& r = results[i];
+        json << "    {\"name\": \"" << r.name << "\", \"mode\": \"" << r.mode << "\", \"threads\": " << r.threads
+             << ", \"runs\": " << r.runs << ", \"wall_seconds\": " << r.wallSeconds
+             << ", \"person_days_per_second\": " << r.personDaysPerSecond()
+             << ", \"peak_rss_kb\": " << r.peakRssKb << ", \"output_bytes\": " << r.outputBytes << "}"
+             << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+}
+
+// Throughput per configuration name from a report written by writeReport
+static std::map<std::string, double> readBaseline(const std::string& filename) {
+    std::ifstream json(filename);
+    std::stringstream content;
+    content << json.rdbuf();
+    std::string text = content.str();
+
+    std::map<std::string, double> throughput;
+    const std::string nameKey = "\"name\": \"";
+    const std::string valueKey = "\"person_days_per_second\": ";
+    for (size_t pos = text.find(nameKey); pos != std::string::npos; pos = text.find(nameKey, pos)) {
+        pos += nameKey.size();
+        std::string name = text.substr(pos, text.find('"', pos) - pos);
+        size_t value = text.find(valueKey, pos);
+        if (value == std::string::npos) break;
+        throughput[name] = std::stod(text.substr(value + valueKey.size()));
+    }
+    return throughput;
+}
+
+int main(int argc, char* argv[]) {
+    ScalingOptions options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--max-threads") options.maxThreads = std::max(1, std::stoi(argv[i + 1]));
+        else if (flag == "--populations") options.populations = std::max(1, std::stoi(argv[i + 1]));
+        else if (flag == "--population-size") options.populationSize = std::max(2, std::stoi(argv[i + 1]));
+        else if (flag == "--runs") options.runs = std::max(1, std::stoi(argv[i + 1]));
+        else if (flag == "--output") options.output = argv[i + 1];
+        else if (flag == "--baseline") options.baseline = argv[i + 1];
+        else if (flag == "--tolerance") options.tolerance = std::stod(argv[i + 1]);
+        else {
+            std::cerr << "Unknown option " << flag << "\n";
+            return 1;
+        }
+    }
+
+    std::vector<int> threadCounts;
+    for (int t = 1; t < options.maxThreads; t *= 2) threadCounts.push_back(t);
+    threadCounts.push_back(options.maxThreads);
+
+    std::vector<ScalingResult> results;
+    std::cout << std::left << std::setw(16) << "Configuration" << std::right << std::setw(8) << "runs"
+              << std::setw(12) << "wall [s]" << std::setw(16) << "person-days/s"
+              << std::setw(14) << "peak RSS [kB]" << std::setw(14) << "output [B]" << "\n";
+
+    for (const std::string mode : {"strong", "weak"}) {
+        for (int threads : threadCounts) {
+            ScalingResult result;
+            result.mode = mode;
+            result.threads = threads;
+            result.runs = mode == "strong" ? options.runs : options.runs * threads;
+            result.name = mode + "/threads=" + std::to_string(threads);
+            if (!measure(options, result)) {
+                std::cerr << "Measurement " << result.name << " failed.\n";
+                return 1;
+            }
+            std::cout << std::left << std::setw(16) << result.name << std::right << std::setw(8) << result.runs
+                      << std::setw(12) << std::fixed << std::setprecision(3) << result.wallSeconds
+                      << std::setw(16) << std::setprecision(0) << result.personDaysPerSecond()
+                      << std::setw(14) << result.peakRssKb << std::setw(14) << result.outputBytes << "\n";
+            results.push_back(result);
+        }
+    }
+
+    writeReport(options.output, options, results);
+    std::cout << "Report written to " << options.output << "\n";
+
+    if (options.baseline.empty()) {
+        return 0;
+    }
+
+    // Regression check against the stored baseline
+    std::map<std::string, double> baseline = readBaseline(options.baseline);
+    bool regressed = false;
+    std::cout << "\nComparison with " << options.baseline << ":\n";
+    for (const auto& result : results) {
+        auto previous = baseline.find(result.name);
+        if (previous == baseline.end() || previous->second <= 0.0) {
+            std::cout << std::left << std::setw(16) << result.name << "  no baseline\n";
+            continue;
+        }
+        double ratio = result.personDaysPerSecond() / previous->second;
+        bool slower = ratio < 1.0 - options.tolerance;
+        regressed = regressed || slower;
+        std::cout << std::left << std::setw(16) << result.name << std::right << std::setw(10)
+                  << std::setprecision(1) << (ratio - 1.0) * 100.0 << "%" << (slower ? "  REGRESSION" : "") << "\n";
+    }
+    return regressed ? 2 : 0;
+}
@@ -1,25 +1,49 @@
 #include "simulation.h"
+#include "random.h"
+#include "stats.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "trace.h"
 #include <algorithm>
 #include <iostream>
 #include <random>
 #include <numeric>
 #include <fstream>
 #include <cmath>
-#include <unordered_map>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <thread>
+#include <type_traits>
 
 
 
+// Random number generator of the calling thread, seeded from the system unless reseeded
+static std::mt19937& randomGenerator() {
+    static thread_local std::mt19937 gen(std::random_device{}());
+    return gen;
+}
+
 // Utility function to generate random numbers
-static int getRandomNumber(int min, int max) {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
+int getRandomNumber(int min, int max) {
     std::uniform_int_distribution<> dis(min, max);
-    return dis(gen);
+    return dis(randomGenerator());
+}
+
+void seedRandomGenerator(unsigned int seed) {
+    randomGenerator().seed(seed);
+}
+
+// 64 random bits from the calling thread's generator
+static std::uint64_t getRandomBits() {
+    std::mt19937& gen = randomGenerator();
+    std::uint64_t high = gen();
+    return high << 32 | gen();
 }
 
 
 // ----- Population Implementation -----
-Population::Population(const std::string& name, int size, double vaccinationRate) : name(name) {
+Population::Population(const std::string& name, int size, double vaccinationRate)
+    : name(name), vaccinationRate(vaccinationRate) {
     int vaccinatedCount = static_cast<int>(size * vaccinationRate);
     for (int i = 0; i < size; ++i) {
         if (i < vaccinatedCount)
@@ -28,9 +52,137 @@ Population::Population(const std::string& name, int size, double vaccinationRate
             individuals.emplace_back(State::Susceptible);
     }
 }
+    infectedTomorrow.assign((size + 63) / 64, 0);
 }
+
+Population::Population(const std::string& name, int size, double vaccinationRate, const AgeStructure& ages)
+    : Population(name, size, vaccinationRate) {
+    if (ages.empty()) return;
+
+    int groups = static_cast<int>(ages.groupFractions.size());
+    double total = 0.0;
+    for (double fraction : ages.groupFractions) total += fraction;
+
+    // Group boundaries from the cumulative fractions; the last group takes the rounding
+    groupStart.assign(groups + 1, size);
+    groupStart[0] = 0;
+    double cumulative = 0.0;
+    for (int g = 1; g < groups; ++g) {
+        cumulative += ages.groupFractions[g - 1];
+        groupStart[g] = std::max(groupStart[g - 1], static_cast<int>(size * cumulative / total));
+    }
+    ageGroups.resize(size);
+    for (int g = 0; g < groups; ++g) {
+        std::fill(ageGroups.begin() + groupStart[g], ageGroups.begin() + groupStart[g + 1], static_cast<std::uint8_t>(g));
+    }
+
+    // Empty groups can't be contacted. A row left without a reachable group (its targets
+    // rounded down to nobody) mixes with the whole population instead
+    contactTargets.resize(groups);
+    for (int g = 0; g < groups; ++g) {
+        std::vector<double> weights(ages.contactMatrix[g]);
+        double reachable = 0.0;
+        for (int target = 0; target < groups; ++target) {
+            if (groupStart[target + 1] == groupStart[target]) weights[target] = 0.0;
+            reachable += std::max(weights[target], 0.0);
+        }
+        if (!(reachable > 0.0)) {
+            for (int target = 0; target < groups; ++target) weights[target] = groupStart[target + 1] - groupStart[target];
+        }
+        contactTargets[g].build(weights);
+    }
+    reset(vaccinationRate);
+}
+
+void Population::reset(double vaccinationRate) {
+    this->vaccinationRate = vaccinationRate;
+    int size = individuals.size();
+    // Every age group (the whole population without age structure) vaccinates its first people
+    int groups = isAgeStructured() ? static_cast<int>(groupStart.size()) - 1 : 1;
+    for (int g = 0; g < groups; ++g) {
+        int first = isAgeStructured() ? groupStart[g] : 0;
+        int last = isAgeStructured() ? groupStart[g + 1] : size;
+        int vaccinatedCount = static_cast<int>((last - first) * vaccinationRate);
+        // Overwrite in place so the existing allocation is reused
+        for (int i = first; i < last; ++i) {
+            individuals[i] = Person(i - first < vaccinatedCount ? State::Vaccinated : State::Susceptible);
+        }
+    }
+    simulatedDays = 0;
+}
+// Draws taken from the thread's shared generator
+struct SequentialDraws {
+    int contact(size_t, int, int size) { return getRandomNumber(0, size - 1); }
+    int chance(size_t, int) { return getRandomNumber(0, 100); }
+    std::uint64_t chanceBits(size_t, int) { return getRandomBits(); }
+    std::uint64_t bits(std::uint64_t) { return getRandomBits(); }
+    std::uint64_t group(size_t, int) { return getRandomBits(); }
+};
+
+// Infectious period fixed at compile time, so the recovery check compares against a constant
+template <int Days>
+struct FixedDuration {
+    static constexpr int days() { return Days; }
+};
+
+// Infectious period only known at run time
+struct RuntimeDuration {
+    int value;
+    int days() const { return value; }
+};
+
+// Draws keyed by (stream, person, day, contact slot) for common random numbers
+struct KeyedDraws {
+    std::uint64_t stream;
+    std::uint64_t day;
+    int contact(size_t person, int slot, int size) {
+        return randomBelow(keyedRandom(stream, person, day, 2 * slot), size);
+    }
+    int chance(size_t person, int slot) {
+        return randomBelow(chanceBits(person, slot), 101);
+    }
+    // The random bits behind chance, for decisions at a finer resolution
+    std::uint64_t chanceBits(size_t person, int slot) {
+        return keyedRandom(stream, person, day, 2 * slot + 1);
+    }
+    // Words for Bernoulli masks, in a slot no contact uses
+    std::uint64_t bits(std::uint64_t counter) {
+        return keyedRandom(stream, counter, day, 0xffffffffULL);
+    }
+    // Target age group of a contact, in a slot range of its own
+    std::uint64_t group(size_t person, int slot) {
+        return keyedRandom(stream, person, day, 0x80000000ULL | slot);
+    }
+};
+
+// Contacts drawn uniformly from the whole population
+struct UniformContacts {
+    int size;
+    template <typename Draws>
+    int pick(Draws& draws, size_t person, int slot) const { return draws.contact(person, slot, size); }
+};
+
+// Contacts drawn from the contact matrix row of the person's age group: the target group
+// through its alias table, then uniformly within the group's contiguous range
+struct StratifiedContacts {
+    const Population& pop;
+    template <typename Draws>
+    int pick(Draws& draws, size_t person, int slot) const {
+        int group = pop.contactTargets[pop.ageGroups[person]].sample(draws.group(person, slot));
+        int first = pop.groupStart[group];
+        return first + draws.contact(person, slot, pop.groupStart[group + 1] - first);
+    }
+};
+
+void Population::useCommonRandomNumbers(std::uint64_t stream) {
+    commonRandomNumbers = true;
+    randomStream = stream;
+}
+
 void Population::initializeInfection() {
-    int index = getRandomNumber(0, individuals.size() - 1);
+    int index = commonRandomNumbers
+        ? randomBelow(keyedRandom(randomStream, 0, 0, 0), individuals.size())
+        : getRandomNumber(0, individuals.size() - 1);
    individuals[index].state = State::Infectious;
      individuals[index].infectionDuration = 0;
     
@@ -52,49 +204,322 @@ int Population::countByState(State state) const{
 
 
 
+StateCounts Population::countStates() const {
+    StateCounts counts{};
+    for (const Person& p : individuals) {
+        counts[static_cast<int>(p.state)]++;
+    }
+    return counts;
+}
+
+void Population::simulateDay(const DiseaseModel& model) {
+    spreadInfections(model);
+    progressInfections(model);
+    applyNewInfections(model);
+}
+
 void Population::simulateDay(int diseaseDuration) {
-    const double transmissibility = 0.15; // Fixed transmissibility for the entire project
-    std::vector<int> newInfections; // Track newly infected individuals
+    simulateDay(DiseaseModel(diseaseDuration));
+}
 
-    for (size_t i = 0; i < individuals.size(); ++i) {
-        if (individuals[i].state == State::Infectious) {
-             
+void Population::simulateDay(int diseaseDuration, double transmissibility) {
+    simulateDay(DiseaseModel(diseaseDuration, transmissibility));
+}
 
-             
-            // Infectious individual contacts 5 random people
-            for (int j = 0; j < 5; ++j) {
-                int contactIndex = getRandomNumber(0, individuals.size() - 1);
+// Call kernel.template operator()<ModelTraits<T>>() for the model's type T
+template <typename Kernel>
+static void dispatchModel(ModelType type, Kernel&& kernel) {
+    switch (type) {
+    case ModelType::SIR: kernel(ModelTraits<ModelType::SIR>{}); break;
+    case ModelType::SEIR: kernel(ModelTraits<ModelType::SEIR>{}); break;
+    case ModelType::SEIRS: kernel(ModelTraits<ModelType::SEIRS>{}); break;
+    case ModelType::SIRV: kernel(ModelTraits<ModelType::SIRV>{}); break;
+    }
+}
 
-                //Skip vaccinated individuals
-                if (individuals[contactIndex].state == State::Vaccinated) {
-                    continue; // Vaccinated individuals do not get infected
+// Call kernel(vaccine) with vaccine a std::integral_constant of the model's vaccine handling
+template <typename Kernel>
+static void dispatchVaccine(VaccineMode mode, Kernel&& kernel) {
+    switch (mode) {
+    case VaccineMode::Perfect: kernel(std::integral_constant<VaccineMode, VaccineMode::Perfect>{}); break;
+    case VaccineMode::Leaky: kernel(std::integral_constant<VaccineMode, VaccineMode::Leaky>{}); break;
+    case VaccineMode::AllOrNothing:
+        kernel(std::integral_constant<VaccineMode, VaccineMode::AllOrNothing>{});
+        break;
+    }
+}
+
+void Population::setDoubleBuffered(bool enabled) {
+    // The second array is allocated by the first day, so initial-state copies don't carry it
+    doubleBuffered = enabled;
+    if (!enabled) {
+        nextIndividuals.clear();
+        nextIndividuals.shrink_to_fit();
+    }
+}
+
+void Population::spreadInfections(const DiseaseModel& model) {
+    beginSpread(model);
+    if (doubleBuffered) {
+        // Tomorrow starts as today progressed; infections are then marked in it
+        progressInfections(model, 0, individuals.size());
+    }
+    for (int chunk = 0; chunk < chunkCount(); ++chunk) {
+        spreadInfections(model, chunk, doubleBuffered ? Marking::NextState : Marking::Bitmap);
+    }
+}
+
+void Population::beginSpread(const DiseaseModel& model) {
+    simulatedDays++;
+
+    // Every word is cleared again when its marks are applied, so only a resized population
+    // needs a new bitmap
+    std::size_t failureWords = (individuals.size() + 63) / 64;
+    if (infectedTomorrow.size() != failureWords) {
+        infectedTomorrow.assign(failureWords, 0);
+    }
+    if (doubleBuffered) {
+        nextIndividuals.resize(individuals.size());
+    }
+
+    if (model.vaccineKernel() == VaccineMode::AllOrNothing &&
+        (simulatedDays == 1 || vaccineFailures.size() != failureWords)) {
+        // Which vaccinations failed is drawn once per run, keyed by day 0 with common random numbers
+        if (commonRandomNumbers) {
+            KeyedDraws draws{randomStream, 0};
+            drawVaccineFailures(model, draws);
+        } else {
+            SequentialDraws draws;
+            drawVaccineFailures(model, draws);
+        }
+    }
+}
+
+void Population::spreadChunk(const DiseaseModel& model, int chunk) {
+    spreadInfections(model, chunk, doubleBuffered ? Marking::AtomicNextState : Marking::AtomicBitmap);
+}
+
+void Population::spreadInfections(const DiseaseModel& model, int chunk, Marking marking) {
+    dispatchModel(model.type, [&](auto traits) {
+        using Traits = decltype(traits);
+        dispatchVaccine(model.vaccineKernel(), [&](auto mode) {
+            auto run = [&](auto contacts, auto infect) {
+                if (commonRandomNumbers) {
+                    KeyedDraws draws{randomStream, static_cast<std::uint64_t>(simulatedDays)};
+                    spreadInfectionsWith<Traits, decltype(mode)::value>(model, contacts, draws, chunk, infect);
+                } else {
+                    SequentialDraws draws;
+                    spreadInfectionsWith<Traits, decltype(mode)::value>(model, contacts, draws, chunk, infect);
+                }
+            };
+            auto withContacts = [&](auto infect) {
+                if (isAgeStructured()) {
+                    run(StratifiedContacts{*this}, infect);
+                } else {
+                    run(UniformContacts{static_cast<int>(individuals.size())}, infect);
                 }
+            };
+            if (marking == Marking::Bitmap) {
+                // Marking is one OR, and marking a person twice changes nothing
+                std::uint64_t* words = infectedTomorrow.data();
+                withContacts([words](int index) { words[index >> 6] |= std::uint64_t(1) << (index & 63); });
+            } else if (marking == Marking::AtomicBitmap) {
+                // Chunks spread concurrently and may hit the same word or person: a relaxed
+                // atomic OR (skipped if the bit is already set) marks each person at most
+                // once, and the set of marks doesn't depend on the order of the chunks
+                std::uint64_t* words = infectedTomorrow.data();
+                withContacts([words](int index) {
+                    std::uint64_t bit = std::uint64_t(1) << (index & 63);
+                    if (!(__atomic_load_n(&words[index >> 6], __ATOMIC_RELAXED) & bit)) {
+                        __atomic_fetch_or(&words[index >> 6], bit, __ATOMIC_RELAXED);
+                    }
+                });
+            } else if (marking == Marking::NextState) {
+                // Contacts were susceptible (or infectable vaccinated) today, which progressing
+                // doesn't change, so tomorrow's state can be overwritten; repeats write the same
+                Person* next = nextIndividuals.data();
+                withContacts([next](int index) {
+                    next[index].state = Traits::latent ? State::Exposed : State::Infectious;
+                    next[index].infectionDuration = 0;
+                });
+            } else {
+                // Concurrent chunks may store into the same person, always the same values
+                Person* next = nextIndividuals.data();
+                withContacts([next](int index) {
+                    __atomic_store_n(&next[index].state, Traits::latent ? State::Exposed : State::Infectious,
+                                     __ATOMIC_RELAXED);
+                    __atomic_store_n(&next[index].infectionDuration, 0, __ATOMIC_RELAXED);
+                });
+            }
+        });
+    });
+}
+
+template <typename Draws>
+void Population::drawVaccineFailures(const DiseaseModel& model, Draws& draws) {
+    // 64 people per mask word; only the bits of vaccinated people are ever read
+    std::uint32_t failureBits = probabilityBits(1.0 - model.vaccineEfficacy);
+    std::uint64_t counter = 0;
+    vaccineFailures.resize((individuals.size() + 63) / 64);
+    for (auto& word : vaccineFailures) {
+        word = bernoulliWord(failureBits, [&] { return draws.bits(counter++); });
+    }
+}
+
+template <typename Traits, VaccineMode Vaccine, typename Contacts, typename Draws, typename Infect>
+void Population::spreadInfectionsWith(const DiseaseModel& model, Contacts sampler, Draws& draws, int chunk,
+                                      Infect infect) {
+    const int contacts = model.contactsPerDay;
+    const int threshold = model.transmissionThreshold;
+    const int breakthroughThreshold = model.breakthroughThreshold;
+    // Leaky protection: a Bernoulli draw keyed by the contact like its transmission draw, so
+    // it doesn't depend on the other contacts and lines up across sweep points
+    const std::uint32_t leakyBits = probabilityBits(model.leakyTransmissibility());
+    const size_t first = static_cast<size_t>(chunk) * chunkSize;
+    const size_t last = std::min(individuals.size(), first + chunkSize);
+    for (size_t i = first; i < last; ++i) {
+        if (individuals[i].state == State::Infectious) {
+            // Infectious individual contacts random people
+            for (int j = 0; j < contacts; ++j) {
+                int contactIndex = sampler.pick(draws, i, j);
+                State contactState = individuals[contactIndex].state;
 
                 // Infect susceptible individuals probabilistically
-                if (individuals[contactIndex].state == State::Susceptible) {
-                    double randomChance = static_cast<double>(getRandomNumber(0, 100)) / 100.0;
-                    if (randomChance < transmissibility) {
-                        newInfections.push_back(contactIndex);
+                if (contactState == State::Susceptible) {
+                    if (draws.chance(i, j) < threshold) {
+                        infect(contactIndex);
+                    }
+                } else if constexpr (Traits::breakthrough) {
+                    // Vaccinated individuals are only infected by breakthrough
+                    if (contactState == State::Vaccinated && draws.chance(i, j) < breakthroughThreshold) {
+                        infect(contactIndex);
+                    }
+                } else if constexpr (Vaccine == VaccineMode::Leaky) {
+                    if (contactState == State::Vaccinated && bernoulliDraw(draws.chanceBits(i, j), leakyBits)) {
+                        infect(contactIndex);
+                    }
+                } else if constexpr (Vaccine == VaccineMode::AllOrNothing) {
+                    // Unprotected vaccinated individuals are as susceptible as the unvaccinated
+                    if (contactState == State::Vaccinated && vaccineFailed(contactIndex) &&
+                        draws.chance(i, j) < threshold) {
+                        infect(contactIndex);
                     }
                 }
             }
-            
-            
-            // Update infection duration and recover individuals after disease duration
-            individuals[i].infectionDuration++;
-            if (individuals[i].infectionDuration >= diseaseDuration) {
-                individuals[i].state = State::Recovered;
+        }
+    }
+}
+
+void Population::progressInfections(const DiseaseModel& model) {
+    if (doubleBuffered) return; // Done while writing tomorrow's states in spreadInfections
+    progressInfections(model, 0, individuals.size());
+}
+
+void Population::progressChunk(const DiseaseModel& model, int chunk) {
+    size_t first = static_cast<size_t>(chunk) * chunkSize;
+    progressInfections(model, first, std::min(individuals.size(), first + chunkSize));
+}
+
+void Population::progressInfections(const DiseaseModel& model, size_t first, size_t last) {
+    dispatchModel(model.type, [&](auto traits) {
+        progressInfectionsFor<decltype(traits)>(model, first, last);
+    });
+}
+
+template <typename Traits>
+void Population::progressInfectionsFor(const DiseaseModel& model, size_t first, size_t last) {
+    auto run = [&](auto duration) {
+        if (doubleBuffered) {
+            progressInfectionsFor<Traits, true>(model, duration, first, last);
+        } else {
+            progressInfectionsFor<Traits, false>(model, duration, first, last);
+        }
+    };
+    // Common durations get a kernel with the duration as a compile-time constant
+    switch (model.duration) {
+    case 1: run(FixedDuration<1>{}); break;
+    case 2: run(FixedDuration<2>{}); break;
+    case 3: run(FixedDuration<3>{}); break;
+    case 5: run(FixedDuration<5>{}); break;
+    case 7: run(FixedDuration<7>{}); break;
+    case 14: run(FixedDuration<14>{}); break;
+    default: run(RuntimeDuration{model.duration}); break;
+    }
+}
 
+template <typename Traits, bool Buffered, typename Duration>
+void Population::progressInfectionsFor(const DiseaseModel& model, Duration duration, size_t first, size_t last) {
+    // Update infection duration and recover individuals after disease duration;
+    // latent and waning models also advance the exposed and recovered states
+    const int days = duration.days();
+    const int latentPeriod = model.latentPeriod;
+    const int immunityDuration = model.immunityDuration;
+    for (size_t i = first; i < last; ++i) {
+        // Double-buffered: advance tomorrow's copy and leave today's state readable
+        Person& person = Buffered ? (nextIndividuals[i] = individuals[i]) : individuals[i];
+        if (person.state == State::Infectious) {
+            person.infectionDuration++;
+            if (person.infectionDuration >= days) {
+                person.state = State::Recovered;
+                if constexpr (Traits::waning) {
+                    person.infectionDuration = 0;
+                }
+            }
+        } else if constexpr (Traits::latent) {
+            if (person.state == State::Exposed) {
+                if (++person.infectionDuration >= latentPeriod) {
+                    person.state = State::Infectious;
+                    person.infectionDuration = 0;
+                }
+            } else if constexpr (Traits::waning) {
+                if (person.state == State::Recovered && ++person.infectionDuration >= immunityDuration) {
+                    person.state = State::Susceptible;
+                    person.infectionDuration = 0;
+                }
             }
         }
     }
+}
+
+void Population::applyNewInfections(const DiseaseModel& model) {
+    if (doubleBuffered) {
+        individuals.swap(nextIndividuals); // Tomorrow's states already hold the infections
+        return;
+    }
+    applyMarked(model, 0, infectedTomorrow.size());
+}
+
+void Population::applyChunk(const DiseaseModel& model, int chunk) {
+    std::size_t firstWord = static_cast<std::size_t>(chunk) * (chunkSize / 64);
+    applyMarked(model, firstWord, std::min(infectedTomorrow.size(), firstWord + chunkSize / 64));
+}
+
+void Population::applyMarked(const DiseaseModel& model, std::size_t firstWord, std::size_t lastWord) {
+    bool vaccinatedInfectable = model.vaccineKernel() != VaccineMode::Perfect;
+    dispatchModel(model.type, [&](auto traits) {
+        applyMarkedFor<decltype(traits)>(vaccinatedInfectable, firstWord, lastWord);
+    });
+}
 
-    // Apply new infections at the end of the day
-    for (int index : newInfections) {
+template <typename Traits>
+void Population::infectIfInfectable(std::size_t index, bool vaccinatedInfectable) {
+    constexpr State infectedState = Traits::latent ? State::Exposed : State::Infectious;
+    State state = individuals[index].state;
+    if (state == State::Susceptible || ((vaccinatedInfectable || Traits::breakthrough) && state == State::Vaccinated)) {
+        individuals[index].state = infectedState;
+        individuals[index].infectionDuration = 0; // Initialize infection duration
+    }
+}
 
-         if (individuals[index].state == State::Susceptible) {
-            individuals[index].state = State::Infectious;
-            individuals[index].infectionDuration = 0; // Initialize infection duration
+template <typename Traits>
+void Population::applyMarkedFor(bool vaccinatedInfectable, std::size_t firstWord, std::size_t lastWord) {
+    // Only words with marks are visited; each set bit is one marked person
+    for (std::size_t w = firstWord; w < lastWord; ++w) {
+        std::uint64_t word = infectedTomorrow[w];
+        if (word == 0) continue;
+        infectedTomorrow[w] = 0;
+        for (; word != 0; word &= word - 1) {
+            infectIfInfectable<Traits>(w * 64 + __builtin_ctzll(word), vaccinatedInfectable);
         }
     }
 }
@@ -103,30 +528,151 @@ void Population::simulateDay(int diseaseDuration) {
 
 // ----- Simulation Implementation -----
 Simulation::Simulation(const std::vector<Population>& pops, int diseaseDuration, double transmissibility)
-    : populations(pops), diseaseDuration(diseaseDuration), transmissibility(transmissibility), dayCount(0) {}
+    : model(diseaseDuration, transmissibility), dayCount(0), commonRandomNumbers(false), randomStream(0),
+      contactDays(0), ensemble(nullptr), personDays(0), populations(pops) {}
+
+Simulation::Simulation(std::vector<Population>&& pops, int diseaseDuration, double transmissibility)
+    : Simulation(std::move(pops), DiseaseModel(diseaseDuration, transmissibility)) {}
+
+Simulation::Simulation(std::vector<Population>&& pops, const DiseaseModel& model)
+    : model(model), dayCount(0), commonRandomNumbers(false), randomStream(0),
+      contactDays(0), ensemble(nullptr), personDays(0), populations(std::move(pops)) {}
+
+void Simulation::setDoubleBuffered(bool enabled) {
+    for (auto& pop : populations) {
+        pop.setDoubleBuffered(enabled);
+    }
+}
+
+void Simulation::setInterventions(const std::vector<InterventionRule>& rules) {
+    dailyModels = compileInterventions(model, rules);
+}
+
+void Simulation::useCommonRandomNumbers(std::uint64_t replicate) {
+    commonRandomNumbers = true;
+    randomStream = combineKeys(replicate, populations.size());
+    contactDays = 0;
+    for (size_t p = 0; p < populations.size(); ++p) {
+        populations[p].useCommonRandomNumbers(combineKeys(replicate, p));
+    }
+}
+
+void Simulation::buildPartnerTable() {
+    std::vector<double> weights;
+    weightedPartners = false;
+    for (const auto& pop : populations) {
+        weights.push_back(pop.mobility);
+        weightedPartners = weightedPartners || pop.mobility != populations.front().mobility;
+    }
+    partnerTable.build(weights);
+}
+
+void Simulation::setMobility(int population, double mobility) {
+    populations[population].mobility = mobility;
+    if (partnerTable.size() != static_cast<int>(populations.size())) {
+        buildPartnerTable();
+        return;
+    }
+    partnerTable.setWeight(population, mobility);
+    weightedPartners = true;
+}
 
 void Simulation::simulateInterPopulationContacts() {
+    const DiseaseModel& today = modelForDay(dayCount);
+    forEachInterPopulationContact(
+        [this](int p) { return static_cast<int>(populations[p].individuals.size()); },
+        [this, &today](int idx1, int person1, int idx2, int person2, auto draw) {
+            if (populations[idx1].individuals[person1].state == State::Infectious) {
+                infectByContact(populations[idx2], person2, draw(), today);
+            }
+        });
+}
+
+void Simulation::collectInterPopulationInfections(const std::vector<int>& sizes,
+                                                  std::vector<ContactInfection>& infections) {
+    // Only populations held by this process have individuals; the others are skipped here
+    // and report their infections on the process that holds them
+    forEachInterPopulationContact(
+        [&sizes](int p) { return sizes[p]; },
+        [this, &infections](int idx1, int person1, int idx2, int person2, auto draw) {
+            const Population& pop1 = populations[idx1];
+            if (!pop1.individuals.empty() && pop1.individuals[person1].state == State::Infectious) {
+                infections.push_back({idx2, person2, draw()});
+            }
+        });
+}
+
+template <typename SizeOf, typename Visit>
+void Simulation::forEachInterPopulationContact(SizeOf sizeOf, Visit visit) {
     if (populations.size() < 2) return;
+    if (partnerTable.size() != static_cast<int>(populations.size())) {
+        buildPartnerTable();
+    }
 
-    int idx1 = getRandomNumber(0, populations.size() - 1);
-    int idx2;
-    do {
-        idx2 = getRandomNumber(0, populations.size() - 1);
-    } while (idx2 == idx1);
+    contactDays++;
+    if (commonRandomNumbers) {
+        KeyedDraws draws{randomStream, static_cast<std::uint64_t>(contactDays)};
+        drawInterPopulationContacts(draws, sizeOf, visit);
+    } else {
+        SequentialDraws draws;
+        drawInterPopulationContacts(draws, sizeOf, visit);
+    }
+}
 
-    Population& pop1 = populations[idx1];
-    Population& pop2 = populations[idx2];
+template <typename Draws, typename SizeOf, typename Visit>
+void Simulation::drawInterPopulationContacts(Draws& draws, SizeOf& sizeOf, Visit& visit) {
+    int idx1, idx2;
+    if (weightedPartners) {
+        // Both partners proportional to mobility; the second is redrawn while it equals the first
+        idx1 = partnerTable.sample(draws.group(0, 0));
+        idx2 = idx1;
+        for (int attempt = 1; idx2 == idx1 && attempt <= 64; ++attempt) {
+            idx2 = partnerTable.sample(draws.group(0, attempt));
+        }
+        if (idx2 == idx1) {
+            idx2 = draws.contact(0, 1, populations.size() - 1);
+            idx2 += idx2 >= idx1 ? 1 : 0;
+        }
+    } else {
+        idx1 = draws.contact(0, 0, populations.size());
+        idx2 = draws.contact(0, 1, populations.size() - 1);
+        if (idx2 >= idx1) {
+            idx2++; // Uniform over the other populations
+        }
+    }
 
-    int contactCount = static_cast<int>(0.05 * std::min(pop1.individuals.size(), pop2.individuals.size()));
+    int size1 = sizeOf(idx1);
+    int size2 = sizeOf(idx2);
+    const DiseaseModel& today = modelForDay(dayCount);
+    int contactCount = static_cast<int>(today.mixingRate * std::min(size1, size2));
     for (int i = 0; i < contactCount; ++i) {
-        int person1 = getRandomNumber(0, pop1.individuals.size() - 1);
-        int person2 = getRandomNumber(0, pop2.individuals.size() - 1);
+        int person1 = draws.contact(1, i, size1);
+        int person2 = draws.contact(2, i, size2);
+        visit(idx1, person1, idx2, person2, [&draws, i] { return draws.chanceBits(1, i); });
+    }
+}
 
-        if (pop1.individuals[person1].state == State::Infectious &&
-            pop2.individuals[person2].state == State::Susceptible) {
-            pop2.individuals[person2].state = State::Infectious;
+bool Simulation::infectByContact(Population& pop, int person, std::uint64_t draw, const DiseaseModel& today) {
+    // The decisions of the intra-population kernel for the contacted person's state
+    State contactState = pop.individuals[person].state;
+    int chance = randomBelow(draw, 101);
+    bool infected = false;
+    if (contactState == State::Susceptible) {
+        infected = chance < today.transmissionThreshold;
+    } else if (contactState == State::Vaccinated) {
+        if (describe(today.type).breakthrough) {
+            infected = chance < today.breakthroughThreshold;
+        } else if (today.vaccineKernel() == VaccineMode::Leaky) {
+            infected = bernoulliDraw(draw, probabilityBits(today.leakyTransmissibility()));
+        } else if (today.vaccineKernel() == VaccineMode::AllOrNothing &&
+                   pop.vaccineFailures.size() * 64 >= pop.individuals.size() && pop.vaccineFailed(person)) {
+            infected = chance < today.transmissionThreshold;
         }
     }
+    if (!infected) return false;
+    pop.individuals[person].state = today.hasExposed() ? State::Exposed : State::Infectious;
+    pop.individuals[person].infectionDuration = 0;
+    return true;
 }
 double Simulation::calculateStandardDeviation(const std::vector<double>& data, double mean) const {
     double sum = 0.0;
@@ -136,79 +682,168 @@ double Simulation::calculateStandardDeviation(const std::vector<double>& data, d
     return std::sqrt(sum / data.size());
 }
 
-void Simulation::runMultipleSimulations(int runs) {
+void Simulation::runMultipleSimulations(int runs, int replicateThreads, unsigned int baseSeed) {
      std::cout << "\nRunning " << runs << " simulation runs...\n";
-   
- // Generate unique filenames for each run
-        // Data storage for total values for each population across runs
-    std::unordered_map<std::string, std::vector<int>> totalSusceptible;
-    std::unordered_map<std::string, std::vector<int>> totalRecovered;
-    std::unordered_map<std::string, std::vector<int>> totalVaccinated;
 
+    // Every run starts from the same initial populations
+    const std::vector<Population> initialPopulations = populations;
+
+    // Streaming statistics per population, compartment and day across runs
+    std::vector<std::string> names;
+    for (const auto& population : populations) {
+        names.push_back(population.name);
+    }
+    EnsembleStatistics statistics(names);
+
+    if (replicateThreads > 1) {
+        // Independent replicates on a thread pool, replicate r seeded with baseSeed + r
+        runReplicateBatch(initialPopulations, 0, runs, replicateThreads, baseSeed, statistics);
+        statistics.writeBands("disease_bands.csv");
+        printEnsembleSummary(statistics);
+        reportTiming();
+        return;
+    }
+    ensemble = &statistics;
 
     for (int i = 0; i < runs; ++i) {
-        std::string detailsFilename = "disease_details_run_" + std::to_string(i + 1) + ".csv";
+        std::string detailsFilename = replicateDetails ? "disease_details_run_" + std::to_string(i + 1) + ".csv" : "";
         std::string statsFilename = "disease_stats_run_" + std::to_string(i) + ".csv";
-        
-        for (auto& population : populations) {
-            
-            population.initializeInfection();
-        }
+
+        populations = initialPopulations;
+        restartRun(commonRandomNumbers, combineKeys(baseSeed, i));
         // Run the simulation
+        ScopedTrace trace("replicate", "run", std::to_string(i + 1));
+        statistics.beginRun();
         start(detailsFilename);
+        statistics.endRun();
          writeSummaryStatistics(statsFilename);
-//Total for each population
-for (const auto& population : populations) {
-            totalSusceptible[population.name].push_back(population.countByState(State::Susceptible));
-            totalRecovered[population.name].push_back(population.countByState(State::Recovered));
-            totalVaccinated[population.name].push_back(population.countByState(State::Vaccinated));
-        }
 
           std::cout << "Run #" << i << " completed. Results saved.\n";
-
-        
     }
+    ensemble = nullptr;
 
+    statistics.writeBands("disease_bands.csv");
+    printEnsembleSummary(statistics);
+    reportTiming();
+}
 
+void Simulation::restartRun(bool keyed, std::uint64_t replicateKey) {
+    // The given populations may already carry the index case of a single run
+    dayCount = 0;
+    lastInfectious.clear();
+    for (auto& population : populations) {
+        population.reset(population.vaccinationRate);
+    }
+    if (keyed) {
+        useCommonRandomNumbers(replicateKey);
+    }
+    for (auto& population : populations) {
+        population.initializeInfection();
+    }
+}
 
+void Simulation::runReplicateBatch(const std::vector<Population>& initialPopulations, int firstRun, int count,
+                                   int replicateThreads, unsigned int baseSeed, EnsembleStatistics& statistics) {
+    std::vector<std::string> names;
+    for (const auto& population : initialPopulations) {
+        names.push_back(population.name);
+    }
+    int workers = std::max(1, std::min(replicateThreads, count));
+    std::vector<EnsembleStatistics> workerStatistics(workers, EnsembleStatistics(names));
+    std::vector<std::uint64_t> workerPersonDays(workers, 0);
+    std::vector<PhaseProfile> workerProfiles(workers);
+
+    parallelFor(count, workers, [&](int task, int worker) {
+        int run = firstRun + task;
+        ScopedTrace trace("replicate", "run", std::to_string(run + 1));
+        seedRandomGenerator(baseSeed + static_cast<unsigned int>(run));
+
+        Simulation replicate(std::vector<Population>(initialPopulations), model);
+        replicate.dailyModels = dailyModels;
+        replicate.restartRun(commonRandomNumbers, combineKeys(baseSeed, run));
+        replicate.profile.setEnabled(profile.isEnabled());
+        if (profile.countersRequested()) {
+            replicate.profile.enableHardwareCounters(); // Counters follow the worker thread
+        }
+        replicate.ensemble = &workerStatistics[worker];
+        workerStatistics[worker].beginRun();
+        replicate.runToEnd(replicateDetails ? "disease_details_run_" + std::to_string(run + 1) + ".csv" : "");
+        workerStatistics[worker].endRun();
+        workerPersonDays[worker] += replicate.personDays;
+        workerProfiles[worker].merge(replicate.profile);
+    });
+
+    for (int w = 0; w < workers; ++w) {
+        statistics.merge(workerStatistics[w]);
+        personDays += workerPersonDays[w];
+        profile.merge(workerProfiles[w]);
+    }
+}
 
-    // Calculate and print average and standard deviation for each property
-    auto calculateStats = [](const std::vector<int>& data) {
-        double mean = std::accumulate(data.begin(), data.end(), 0.0) / data.size();
-        double variance = 0.0;
-        for (int value : data) {
-            variance += (value - mean) * (value - mean);
+int Simulation::runAdaptiveSimulations(double targetHalfWidth, double confidence, int minRuns, int maxRuns,
+                                       int batchSize, int replicateThreads, unsigned int baseSeed) {
+    std::cout << "\nRunning replicates until the " << confidence * 100 << "% confidence half-width of "
+              << "the recovered count is at most " << targetHalfWidth << " (max " << maxRuns << " runs)...\n";
+
+    const std::vector<Population> initialPopulations = populations;
+    std::vector<std::string> names;
+    for (const auto& population : populations) {
+        names.push_back(population.name);
+    }
+    EnsembleStatistics statistics(names);
+
+    batchSize = std::max(1, batchSize);
+    minRuns = std::max(2, minRuns);
+    int runs = 0;
+    bool converged = false;
+
+    while (!converged && runs < maxRuns) {
+        int batch = std::min(runs == 0 ? std::max(batchSize, minRuns) : batchSize, maxRuns - runs);
+        runReplicateBatch(initialPopulations, runs, batch, replicateThreads, baseSeed, statistics);
+        runs += batch;
+
+        // Converged once every population's recovered count is known precisely enough
+        double widest = 0.0;
+        for (size_t p = 0; p < names.size(); ++p) {
+            widest = std::max(widest, confidenceHalfWidth(statistics.finalStatistics(p, Compartment::Recovered), confidence));
         }
-        variance /= data.size();
-        return std::make_pair(mean, std::sqrt(variance));
-    };
+        converged = runs >= minRuns && widest <= targetHalfWidth;
+        std::cout << runs << " runs completed, widest half-width " << widest << "\n";
+    }
+
+    if (!converged) {
+        std::cout << "Target precision not reached within " << maxRuns << " runs.\n";
+    }
+
+    statistics.writeBands("disease_bands.csv");
+    printEnsembleSummary(statistics);
+    reportTiming();
+    return runs;
+}
 
-    std::cout << "\nSimulation Statistics Across " << runs << " Runs:\n";
+void Simulation::printEnsembleSummary(const EnsembleStatistics& statistics) const {
+    std::cout << "\nSimulation Statistics Across " << statistics.runCount() << " Runs:\n";
     std::cout << "--------------------------------------------------\n";
     std::cout << "Population       | Property       | Mean          | Std Dev\n";
     std::cout << "--------------------------------------------------\n";
 
     // Print stats for each population
-    for (const auto& [name, values] : totalSusceptible) {
-        auto [mean, stdDev] = calculateStats(values);
-        std::cout << name << "       | Susceptible    | " << mean << "       | " << stdDev << "\n";
-    }
-    for (const auto& [name, values] : totalRecovered) {
-        auto [mean, stdDev] = calculateStats(values);
-        std::cout << name << "       | Recovered      | " << mean << "       | " << stdDev << "\n";
-    }
-    for (const auto& [name, values] : totalVaccinated) {
-        auto [mean, stdDev] = calculateStats(values);
-        std::cout << name << "       | Vaccinated     | " << mean << "       | " << stdDev << "\n";
+    for (Compartment compartment : {Compartment::Susceptible, Compartment::Recovered, Compartment::Vaccinated}) {
+        for (size_t p = 0; p < populations.size(); ++p) {
+            const RunningStatistics& values = statistics.finalStatistics(p, compartment);
+            std::string property = compartmentName(compartment);
+            property.resize(15, ' ');
+            std::cout << populations[p].name << "       | " << property << "| " << values.mean()
+                      << "       | " << values.stdDev() << "\n";
+        }
     }
 
     std::cout << "--------------------------------------------------\n";
+    std::cout << "Daily mean and 5/50/95% bands saved to disease_bands.csv\n";
 }
 
-    
-
-
 void Simulation::writeSummaryStatistics(const std::string& statsFilename) {
+    ScopedTrace trace("writeSummaryStatistics", "output", statsFilename);
     std::ofstream statsFile(statsFilename); // Open the file
     if (!statsFile.is_open()) {
         std::cerr << "Error: Could not open file " << "disease_stats.csv" << " for writing summary statistics.\n";
@@ -237,53 +872,250 @@ void Simulation::writeSummaryStatistics(const std::string& statsFilename) {
     statsFile.close(); // Close the file
     std::cout << "Summary statistics written to " << statsFilename << "\n";
 }
-void Simulation::start(const std::string& detailsFilename) {
-    bool hasInfectious = true;
+void Simulation::writeDailyRow(std::ostream& outputFile, int day, const std::string& name,
+                               int susceptible, int infectious, int recovered, int vaccinated) {
+    outputFile << day << ","
+               << name << ","
+               << susceptible << ","
+               << infectious << ","
+               << recovered << ","
+               << vaccinated << "\n";
+}
+
+std::string Simulation::dailyHeader(const DiseaseModel& model) {
+    return model.hasExposed() ? "Day,Population,Susceptible,Exposed,Infectious,Recovered,Vaccinated\n"
+                              : "Day,Population,Susceptible,Infectious,Recovered,Vaccinated\n";
+}
+
+void Simulation::writeDailyRow(std::ostream& outputFile, int day, const std::string& name,
+                               const StateCounts& counts, const DiseaseModel& model) {
+    outputFile << day << "," << name << "," << counts[static_cast<int>(State::Susceptible)] << ",";
+    if (model.hasExposed()) {
+        outputFile << counts[static_cast<int>(State::Exposed)] << ",";
+    }
+    outputFile << counts[static_cast<int>(State::Infectious)] << ","
+               << counts[static_cast<int>(State::Recovered)] << ","
+               << counts[static_cast<int>(State::Vaccinated)] << "\n";
+}
+
+StateCounts Simulation::simulatePopulationDay(Population& pop, const DiseaseModel& today) {
+    {
+        ScopedTrace trace("simulateDay", "population", pop.name);
+        {
+            ScopedPhase timer(profile, Phase::Infection);
+            pop.spreadInfections(today);
+        }
+        {
+            ScopedPhase timer(profile, Phase::Recovery);
+            pop.progressInfections(today);
+            pop.applyNewInfections(today);
+        }
+    }
+
+    ScopedPhase timer(profile, Phase::Counting);
+    return pop.countStates();
+}
+
+std::vector<StateCounts> Simulation::simulatePopulationsParallel(const DiseaseModel& today) {
+    // A contact (random access) costs about as much as scanning this many people
+    constexpr double contactCost = 8.0;
+    if (!commonRandomNumbers) {
+        useCommonRandomNumbers(getRandomBits());
+    }
+    if (!workerPool || workerPool->size() != threadCount) {
+        workerPool = std::make_unique<WorkerPool>(threadCount);
+        workerCounters.clear(); // Bound to the old pool's threads
+    }
+    if (lastInfectious.size() != populations.size()) {
+        lastInfectious.clear();
+        for (const auto& pop : populations) {
+            lastInfectious.push_back(pop.countByState(State::Infectious));
+        }
+    }
 
-    // Open a CSV file to store daily results
-    std::ofstream outputFile(detailsFilename);
-    outputFile << "Day,Population,Susceptible,Infectious,Recovered,Vaccinated\n";
-
-    while (hasInfectious) {
-        dayCount++;
-        hasInfectious = false;
-
-                
-
-         
-
-        for (auto& pop : populations) {
-            pop.simulateDay(3);
-
-int infectious = pop.countByState(State::Infectious);
-            int recovered = pop.countByState(State::Recovered);
-            int susceptible = pop.countByState(State::Susceptible);
-            int vaccinated = pop.countByState(State::Vaccinated);
-
-             
-            // Write results to the CSV file
-            outputFile << dayCount << ","
-                        << pop.name << ","
-                        << susceptible << ","
-                        << infectious << ","
-                        << recovered << ","
-                        << vaccinated << "\n";
- 
-            // Write detailed results to disease_details.csv
-            
-            // Check if any infectious individuals remain
-            if (pop.countByState(State::Infectious) > 0) {
-                
-                hasInfectious = true;
+    // Every chunk is a task; its spread cost is the scan plus its share of yesterday's contacts.
+    // Double-buffered populations first progress every chunk into tomorrow's states (where the
+    // spread then marks infections) and swap the arrays as one task (chunk -1).
+    std::vector<std::pair<int, int>> copyTasks, spreadTasks, progressTasks;
+    std::vector<double> copyCosts, spreadCosts, progressCosts, populationCosts;
+    for (size_t p = 0; p < populations.size(); ++p) {
+        Population& pop = populations[p];
+        double size = pop.individuals.size();
+        populationCosts.push_back(size);
+        pop.beginSpread(today);
+        for (int c = 0; c < pop.chunkCount(); ++c) {
+            double length = std::min<double>(Population::chunkSize, size - c * static_cast<double>(Population::chunkSize));
+            spreadTasks.emplace_back(p, c);
+            spreadCosts.push_back(length + contactCost * today.contactsPerDay * lastInfectious[p] * length / size);
+            if (pop.isDoubleBuffered()) {
+                copyTasks.emplace_back(p, c);
+                copyCosts.push_back(2 * length);
+            } else {
+                progressTasks.emplace_back(p, c);
+                progressCosts.push_back(length);
             }
         }
+        if (pop.isDoubleBuffered()) {
+            progressTasks.emplace_back(p, -1);
+            progressCosts.push_back(1);
+        }
+    }
+
+    // The phase timers read the calling thread (worker 0), so every other worker reads its
+    // own counters around its tasks and adds them to the phase
+    bool countWorkers = profile.hasCounters();
+    if (countWorkers && static_cast<int>(workerCounters.size()) != threadCount) {
+        workerCounters.clear();
+        workerCounters.resize(threadCount);
+    }
+    auto runTasks = [&](Phase phase, const char* name, const std::vector<double>& costs, auto&& task) {
+        std::vector<CounterValues> totals(threadCount, CounterValues{});
+        workerPool->runStealing(costs, [&](int t, int worker) {
+            bool tracing = TraceRecorder::instance().isEnabled();
+            ScopedTrace trace(name, "worker", tracing ? "worker " + std::to_string(worker) : std::string());
+            PerfCounters* counters = nullptr;
+            if (countWorkers && worker > 0) {
+                if (!workerCounters[worker]) workerCounters[worker] = std::make_unique<PerfCounters>();
+                if (workerCounters[worker]->isAvailable()) counters = workerCounters[worker].get();
+            }
+            CounterValues begin = counters ? counters->read() : CounterValues{};
+            task(t);
+            if (counters) {
+                CounterValues end = counters->read();
+                for (int c = 0; c < counterCount; ++c) totals[worker][c] += end[c] - begin[c];
+            }
+        });
+        for (int worker = 1; worker < threadCount; ++worker) {
+            profile.addCounters(phase, CounterValues{}, totals[worker]);
+        }
+    };
+
+    {
+        ScopedPhase timer(profile, Phase::Infection);
+        runTasks(Phase::Infection, "progressChunk", copyCosts, [&](int t) {
+            populations[copyTasks[t].first].progressChunk(today, copyTasks[t].second);
+        });
+        runTasks(Phase::Infection, "spreadChunk", spreadCosts, [&](int t) {
+            populations[spreadTasks[t].first].spreadChunk(today, spreadTasks[t].second);
+        });
+    }
+    {
+        // Every chunk's people only depend on its own marks, so a chunk progresses and applies
+        // without waiting for the others
+        ScopedPhase timer(profile, Phase::Recovery);
+        runTasks(Phase::Recovery, "progressChunk", progressCosts, [&](int t) {
+            Population& pop = populations[progressTasks[t].first];
+            if (progressTasks[t].second < 0) {
+                pop.applyNewInfections(today);
+            } else {
+                pop.progressChunk(today, progressTasks[t].second);
+                pop.applyChunk(today, progressTasks[t].second);
+            }
+        });
+    }
+
+    std::vector<StateCounts> counts(populations.size());
+    {
+        ScopedPhase timer(profile, Phase::Counting);
+        runTasks(Phase::Counting, "countStates", populationCosts, [&](int p) {
+            counts[p] = populations[p].countStates();
+        });
+    }
+    for (size_t p = 0; p < populations.size(); ++p) {
+        lastInfectious[p] = counts[p][static_cast<int>(State::Infectious)];
+    }
+    return counts;
+}
 
+bool Simulation::simulateNextDay(std::ostream& outputFile) {
+    bool hasInfectious = false;
+    dayCount++;
+
+    profile.beginDay(dayCount);
+    const DiseaseModel& today = modelForDay(dayCount);
+    std::vector<StateCounts> parallelCounts;
+    if (threadCount > 1) {
+        parallelCounts = simulatePopulationsParallel(today);
+    }
+
+    for (size_t p = 0; p < populations.size(); ++p) {
+        Population& pop = populations[p];
+        StateCounts counts = threadCount > 1 ? parallelCounts[p] : simulatePopulationDay(pop, today);
+
+        // Write results to the CSV file
+        {
+            ScopedPhase timer(profile, Phase::CsvWrite);
+            writeDailyRow(outputFile, dayCount, pop.name, counts, model);
+        }
+        personDays += pop.individuals.size();
+
+        if (ensemble) {
+            ensemble->record(dayCount, p, {counts[static_cast<int>(State::Susceptible)],
+                                           counts[static_cast<int>(State::Infectious)],
+                                           counts[static_cast<int>(State::Recovered)],
+                                           counts[static_cast<int>(State::Vaccinated)]});
+        }
+
+        // Check if any infectious (or exposed) individuals remain
+        if (counts[static_cast<int>(State::Infectious)] + counts[static_cast<int>(State::Exposed)] > 0) {
+            hasInfectious = true;
+        }
+    }
+
+    {
+        ScopedTrace trace("interPopulationContacts", "day");
+        ScopedPhase timer(profile, Phase::InterPopulation);
         simulateInterPopulationContacts();
     }
+    return hasInfectious && (model.maxDays <= 0 || dayCount < model.maxDays);
+}
+
+void Simulation::enableTiming(const std::string& dailyCsvFilename) {
+    profile.setEnabled(true);
+    timingCsvFilename = dailyCsvFilename;
+}
+
+bool Simulation::enableHardwareCounters() {
+    profile.setEnabled(true);
+    return profile.enableHardwareCounters();
+}
 
+void Simulation::reportTiming() const {
+    if (!profile.isEnabled()) {
+        return;
+    }
+    profile.printSummary(std::cout);
+    profile.printCounterSummary(std::cout, personDays);
+    if (!timingCsvFilename.empty()) {
+        profile.writeDailyCsv(timingCsvFilename);
+        std::cout << "Daily phase timings saved to " << timingCsvFilename << "\n";
+    }
+}
+
+void Simulation::runToEnd(const std::string& detailsFilename) {
+    if (detailsFilename.empty()) {
+        std::ostream discard(nullptr); // Rows are only counted
+        while (simulateNextDay(discard)) {
+        }
+        return;
+    }
+
+    // Open a CSV file to store daily results, buffered in accounted memory
+    TrackedVector<char, MemoryCategory::OutputBuffers> buffer(outputBufferSize);
+    std::ofstream outputFile;
+    outputFile.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    outputFile.open(detailsFilename);
+    outputFile << dailyHeader(model);
+
+    while (simulateNextDay(outputFile)) {
+    }
+
+    ScopedTrace trace("flushOutput", "output", detailsFilename);
     outputFile.close();
+}
 
- //writeSummaryStatistics(statsFilename);
+void Simulation::start(const std::string& detailsFilename) {
+    runToEnd(detailsFilename);
 
     // Print summary to the terminal
     std::cout << "\nSimulation Results:\n";
@@ -294,88 +1126,160 @@ int infectious = pop.countByState(State::Infectious);
         std::cout << "  Recovered: " << pop.countByState(State::Recovered) << "\n";
         std::cout << "  Vaccinated: " << pop.countByState(State::Vaccinated) << "\n";
     }
-    std::cout << "Results saved to"<<  detailsFilename << "'.\n";
-    
-    
+    if (!detailsFilename.empty()) {
+        std::cout << "Results saved to"<<  detailsFilename << "'.\n";
+    }
+
+    if (!ensemble) {
+        reportTiming(); // Ensembles report once after the last run
+    }
 }
 
-void Simulation::startSinglePopulationExperiment() {
-    bool hasInfectious = true;  // To track if there are still infectious individuals
+int Simulation::runBranches(int branchDay, int branchCount, unsigned int baseSeed,
+                            const std::string& filenamePrefix,
+                            const std::function<void(Simulation&, int)>& configureBranch) {
+    // Shared prefix: simulated once in this process
+    std::string prefixFilename = filenamePrefix + "_prefix.csv";
+    std::ofstream prefixFile(prefixFilename);
+    prefixFile << dailyHeader(model);
+    bool hasInfectious = true;
+    while (dayCount < branchDay && hasInfectious) {
+        hasInfectious = simulateNextDay(prefixFile);
+    }
+    prefixFile.close();
+    std::cout << "Shared prefix simulated up to day " << dayCount
+              << ", branching into " << branchCount << " scenarios.\n";
+
+    // Flush before forking so buffered output is not duplicated in every child, and stop
+    // the worker threads, which a child wouldn't have (it starts its own)
+    std::cout.flush();
+    std::cerr.flush();
+    workerPool.reset();
+
+    int maxConcurrent = std::max(1u, std::thread::hardware_concurrency());
+    int running = 0;
+    int failed = 0;
+
+    auto waitForBranch = [&]() {
+        int status = 0;
+        if (waitpid(-1, &status, 0) > 0) {
+            running--;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                failed++;
+            }
+        }
+    };
 
-    // Open CSV file for saving the results
-    std::ofstream outputFile("single_population_results.csv");
-    outputFile << "Day,Population,Susceptible,Infectious,Recovered,Vaccinated\n";
+    for (int branch = 0; branch < branchCount; ++branch) {
+        if (running >= maxConcurrent) {
+            waitForBranch();
+        }
 
-    // Day-by-day simulation loop
-    while (hasInfectious) {
-        dayCount++;
-        hasInfectious = false;
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "Error: Could not fork scenario branch " << branch << ".\n";
+            failed++;
+            continue;
+        }
 
-        for (auto& pop : populations) {
-            std::vector<int> newInfections;  // Track newly infected indices
+        if (pid == 0) {
+            // Child: the population state is shared copy-on-write with the parent
+            // until this branch starts modifying it
+            seedRandomGenerator(baseSeed + static_cast<unsigned int>(branch) + 1);
+            if (commonRandomNumbers) {
+                // Keyed draws don't see the seed: the branch continues on streams of its own
+                // from the prefix's day indices
+                int days = contactDays;
+                useCommonRandomNumbers(combineKeys(randomStream, branch + 1));
+                contactDays = days;
+            }
+            if (configureBranch) {
+                configureBranch(*this, branch);
+            }
 
-            // Process each individual
-            for (size_t i = 0; i < pop.individuals.size(); ++i) {
-                if (pop.individuals[i].state == State::Infectious) {
-                    // Infect 5 random susceptible individuals
-                    for (int j = 0; j < ceil(5 * 0.15); ++j) {
-                        int contactIndex = getRandomNumber(0, pop.individuals.size() - 1);
-                        if (pop.individuals[contactIndex].state == State::Susceptible) {
-                            newInfections.push_back(contactIndex);
-                        }
-                    }
+            std::string branchName = filenamePrefix + "_branch_" + std::to_string(branch);
+            TrackedVector<char, MemoryCategory::OutputBuffers> buffer(outputBufferSize);
+            std::ofstream outputFile;
+            outputFile.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+            outputFile.open(branchName + ".csv");
+            outputFile << dailyHeader(model);
+            bool branchInfectious = hasInfectious;
+            while (branchInfectious) {
+                branchInfectious = simulateNextDay(outputFile);
+            }
+            outputFile.close();
 
-                    // Update infection duration
-                    pop.individuals[i].infectionDuration++;
+            writeSummaryStatistics(branchName + "_stats.csv");
+            std::cout << "Branch #" << branch << " finished after " << dayCount << " days.\n";
+            std::cout.flush();
+            _exit(outputFile.fail() ? 1 : 0);
+        }
 
-                    if (pop.individuals[i].infectionDuration >= diseaseDuration) {
-                        pop.individuals[i].state = State::Recovered;
-                    }
+        running++;
+    }
 
-                   for( int n : newInfections){
-                        //pop.individuals[n].state = State::Recovered
-                        if (pop.individuals[n].infectionDuration >= diseaseDuration) {
-                            pop.individuals[n].state = State::Recovered;
-                        }
-                        else{
-                            pop.individuals[n].infectionDuration++;
-                        }
-                    }
-            }}
+    while (running > 0) {
+        waitForBranch();
+    }
 
-           // Apply new infections
-            for (int index : newInfections) {
-                pop.individuals[index].state = State::Infectious;
-            }
-            
+    return failed;
+}
 
-            // Check if there are still infectious individuals
-            if (pop.countByState(State::Infectious) > 0) {
-                hasInfectious = true;
-                std::cout << pop.countByState(State::Infectious) << std::endl;
-            }
+int Simulation::runSinglePopulation(Population& pop, std::ostream* dailyRows) {
+    int days = 0;
+    int active = 0;
+    do {
+        days++;
+        const DiseaseModel& today = modelForDay(days);
+        pop.spreadInfections(today);
+        pop.progressInfections(today);
+        pop.applyNewInfections(today);
+
+        StateCounts counts = pop.countStates();
+        active = counts[static_cast<int>(State::Infectious)] + counts[static_cast<int>(State::Exposed)];
+        if (dailyRows) {
+            writeDailyRow(*dailyRows, days, pop.name, counts, model);
+        }
+    } while (active > 0 && (model.maxDays <= 0 || days < model.maxDays));
+
+    personDays += static_cast<std::uint64_t>(days) * pop.individuals.size();
+    return days;
+}
 
-            // Write daily stats to the CSV file
-            outputFile << dayCount << ","
-                       << pop.name << ","
+void Simulation::startSinglePopulationExperiment(const std::string& filename, int runs) {
+    TrackedVector<char, MemoryCategory::OutputBuffers> buffer(outputBufferSize);
+    std::ofstream outputFile;
+    outputFile.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    outputFile.open(filename);
+
+    Population& pop = populations.front();
+    if (runs <= 1) {
+        // One trajectory, one row per day
+        outputFile << dailyHeader(model);
+        dayCount = runSinglePopulation(pop, &outputFile);
+    } else {
+        // Calibration loops: only the final state of every run is written. Every run restarts
+        // from the vaccination state with an index case of its own.
+        outputFile << "Run,Days,Susceptible,Infectious,Recovered,Vaccinated\n";
+        for (int run = 0; run < runs; ++run) {
+            pop.reset(pop.vaccinationRate);
+            pop.initializeInfection();
+            dayCount = runSinglePopulation(pop, nullptr);
+            outputFile << run + 1 << "," << dayCount << ","
                        << pop.countByState(State::Susceptible) << ","
                        << pop.countByState(State::Infectious) << ","
                        << pop.countByState(State::Recovered) << ","
                        << pop.countByState(State::Vaccinated) << "\n";
         }
     }
-
     outputFile.close();
 
     // Print summary results to terminal
     std::cout << "\nSingle Population Experiment Results:\n";
+    std::cout << "Runs: " << std::max(runs, 1) << "\n";
     std::cout << "Total Days: " << dayCount << "\n";
-    for (const auto& pop : populations) {
-        std::cout << "Population: " << pop.name << "\n";
-        std::cout << "Infectious" << pop.countByState(State::Infectious) << std::endl;
-        std::cout << "  Susceptible: " << pop.countByState(State::Susceptible) << "\n";
-        std::cout << "  Recovered: " << pop.countByState(State::Recovered) << "\n";
-        std::cout << "  Vaccinated: " << pop.countByState(State::Vaccinated) << "\n";
-    }
-    //std::cout << "Results saved to 'single_population_results.csv'.\n";
+    std::cout << "Population: " << pop.name << "\n";
+    std::cout << "  Susceptible: " << pop.countByState(State::Susceptible) << "\n";
+    std::cout << "  Recovered: " << pop.countByState(State::Recovered) << "\n";
+    std::cout << "  Vaccinated: " << pop.countByState(State::Vaccinated) << "\n";
 }
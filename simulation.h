@@ -2,16 +2,42 @@
 #define SIMULATION_H
 
 #include <vector>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include "profiler.h"
+#include "memory.h"
+#include "disease_model.h"
+#include "intervention.h"
+#include "age_structure.h"
+#include "alias_table.h"
+#include "parallel.h"
 #include <string>
+#include <ostream>
+#include <functional>
+#include <memory>
 
-// Enumeration for the states of individuals
-enum class State { Susceptible, Infectious, Vaccinated, Recovered };
+class EnsembleStatistics;
+
+// Uniform random integer in [min, max] from the calling thread's generator
+int getRandomNumber(int min, int max);
+
+// Reseed the random number generator of the calling thread
+void seedRandomGenerator(unsigned int seed);
+
+// Enumeration for the states of individuals (Exposed only occurs in latent-period models)
+enum class State { Susceptible, Infectious, Vaccinated, Recovered, Exposed };
+
+constexpr int stateCount = 5;
+
+// Number of individuals in each state, indexed by State
+using StateCounts = std::array<int, stateCount>;
 
 // Class representing a person
 class Person {
 public:
     State state;             // Current state of the person
-    int infectionDuration;   // Duration the person has been infectious
+    int infectionDuration;   // Days spent in the current exposed, infectious or recovered state
 
     // Constructor
     Person(State initState= State::Susceptible): state(initState), infectionDuration(0){};
@@ -21,32 +47,222 @@ public:
 class Population {
 public:
     std::string name;                // Name of the population
-    std::vector<Person> individuals; // List of individuals in the population
+    double mobility = 1.0;           // Relative weight of being chosen for inter-population contacts
+    double vaccinationRate = 0.0;    // Fraction vaccinated at the start of a run
+    TrackedVector<Person, MemoryCategory::PopulationState> individuals; // List of individuals in the population
   
     // Constructor
     Population(const std::string& name, int size, double vaccinationRate);
 
+    // Age-structured population: people are stored contiguously by age group and the
+    // same fraction of every group is vaccinated
+    Population(const std::string& name, int size, double vaccinationRate, const AgeStructure& ages);
+
     // Initialize one individual as infectious
     void initializeInfection();
 
     // Count the number of individuals in a given state
     int countByState(State state) const;
 
+    // Count every state in one pass
+    StateCounts countStates() const;
+
+    // Reset every individual to the initial state for the given vaccination rate, reusing the storage
+    void reset(double vaccinationRate);
+
     // Simulate a single day in the population
+    void simulateDay(const DiseaseModel& model);
+
+    // Shorthands for the default model with the given duration (and transmissibility)
     void simulateDay(int diseaseDuration);
+    void simulateDay(int diseaseDuration, double transmissibility);
 
-    std::vector<int> newInfections;
+    // The phases of simulateDay, callable separately so they can be timed:
+    // infectious contacts mark infectedTomorrow, then every timed state advances
+    // (exposed, infectious, recovered), then the new infections are applied.
+    // Each phase dispatches to a kernel compiled for the model type.
+    void spreadInfections(const DiseaseModel& model);
+    void progressInfections(const DiseaseModel& model);
+    void applyNewInfections(const DiseaseModel& model);
 
-    
+    // Double-buffered state: spreadInfections writes tomorrow's states into a second array,
+    // copying and progressing every person and then marking the infections in place (an
+    // idempotent write, so no bitmap to sweep); progressInfections has nothing left to do and
+    // applyNewInfections swaps the arrays. Same results as the default mode, twice the state.
+    // Chunked, progressChunk writes tomorrow's copy of its people, so every chunk has to
+    // progress before any spreads; spreadChunk then marks with relaxed atomic stores.
+    void setDoubleBuffered(bool enabled);
+    bool isDoubleBuffered() const { return doubleBuffered; }
+
+    // The same phases on chunks of chunkSize people for the population scheduler:
+    // beginSpread once per day, then spreadChunk on any chunks concurrently (marking
+    // infections in infectedTomorrow with a lock-free OR), then progressChunk followed by
+    // applyChunk per chunk, independently of the other chunks. Double-buffered: beginSpread,
+    // progressChunk on every chunk, spreadChunk on every chunk, then applyNewInfections.
+    // Chunked and whole-population days draw the same keyed random numbers.
+    static constexpr int chunkSize = 1 << 16;
+    int chunkCount() const { return static_cast<int>((individuals.size() + chunkSize - 1) / chunkSize); }
+    void beginSpread(const DiseaseModel& model);
+    void spreadChunk(const DiseaseModel& model, int chunk);
+    void progressChunk(const DiseaseModel& model, int chunk);
+    void applyChunk(const DiseaseModel& model, int chunk);
+
+    // Key all draws by (stream, person, day, contact slot) instead of the shared
+    // generator, so runs with different parameters see the same randomness. The day
+    // index keeps counting, so a run can switch streams mid-way; reset restarts it.
+    void useCommonRandomNumbers(std::uint64_t stream);
+
+    TrackedVector<Person, MemoryCategory::PopulationState> nextIndividuals; // Tomorrow's states when double-buffered
+    // Newly infected people of the current day, one bit per person; sized with the population
+    // and cleared word by word while applying
+    TrackedVector<std::uint64_t, MemoryCategory::Scratch> infectedTomorrow;
+
+    // All-or-nothing vaccine: bit i set if person i's vaccination failed to protect,
+    // drawn at the start of every run
+    TrackedVector<std::uint64_t, MemoryCategory::PopulationState> vaccineFailures;
+
+    bool vaccineFailed(std::size_t index) const { return vaccineFailures[index >> 6] >> (index & 63) & 1; }
+
+    // Age structure (empty for homogeneous mixing): the group of every person, the first
+    // index of every group (plus one past the end) and, per source group, an alias table
+    // over the target groups built from the contact matrix row
+    TrackedVector<std::uint8_t, MemoryCategory::PopulationState> ageGroups;
+    std::vector<int> groupStart;
+    std::vector<AliasTable> contactTargets;
+
+    bool isAgeStructured() const { return !contactTargets.empty(); }
+
+private:
+    bool commonRandomNumbers = false; // Use keyed draws instead of the shared generator
+    std::uint64_t randomStream = 0;   // Key of this population's random stream
+    int simulatedDays = 0;            // Day index used to key the draws
+    bool doubleBuffered = false;      // Write tomorrow's states into nextIndividuals
+
+    // Where spreading records an infection: a plain or (for concurrent chunks) atomic OR into
+    // infectedTomorrow, or a plain or atomic store of tomorrow's state in nextIndividuals
+    enum class Marking { Bitmap, AtomicBitmap, NextState, AtomicNextState };
+
+    // Spread from the infectious people of one chunk, recording infections by marking
+    void spreadInfections(const DiseaseModel& model, int chunk, Marking marking);
+
+    template <typename Traits, VaccineMode Vaccine, typename Contacts, typename Draws, typename Infect>
+    void spreadInfectionsWith(const DiseaseModel& model, Contacts contacts, Draws& draws, int chunk, Infect infect);
+
+    template <typename Draws>
+    void drawVaccineFailures(const DiseaseModel& model, Draws& draws);
+
+    // Advance the timed states of people first .. last - 1
+    void progressInfections(const DiseaseModel& model, std::size_t first, std::size_t last);
+
+    template <typename Traits>
+    void progressInfectionsFor(const DiseaseModel& model, std::size_t first, std::size_t last);
+
+    template <typename Traits, bool Buffered, typename Duration>
+    void progressInfectionsFor(const DiseaseModel& model, Duration duration, std::size_t first, std::size_t last);
+
+    // Apply and clear the marks of bitmap words firstWord .. lastWord - 1
+    void applyMarked(const DiseaseModel& model, std::size_t firstWord, std::size_t lastWord);
+
+    template <typename Traits>
+    void applyMarkedFor(bool vaccinatedInfectable, std::size_t firstWord, std::size_t lastWord);
+
+    // Infect a person marked today unless progressing made them uninfectable
+    template <typename Traits>
+    void infectIfInfectable(std::size_t index, bool vaccinatedInfectable);
+};
+
+// Infection of a person in another population by an inter-population contact
+struct ContactInfection {
+    int population;
+    int person;
+    std::uint64_t draw;  // Random bits of the transmission decision, made where the person is held
 };
 
 // Class representing the entire simulation
 class Simulation {
 private:
     //std::vector<Population> populations; // List of populations
-    int diseaseDuration;                 // Duration of the disease in days
-    double transmissibility;             // Probability of disease transmission
+    DiseaseModel model;                  // Duration, transmissibility and contacts per day
+    std::vector<DiseaseModel> dailyModels; // Model of each day with interventions, indexed by day
+    AliasTable partnerTable;             // Inter-population partners by mobility
+    bool weightedPartners = false;       // Some mobility differs, otherwise partners are uniform
+
+    // Build partnerTable from the populations' mobility
+    void buildPartnerTable();
     int dayCount;                        // Count of simulation days
+    bool commonRandomNumbers;            // Inter-population draws are keyed by replicate and day
+    std::uint64_t randomStream;          // Key of the inter-population random stream
+    int contactDays;                     // Day index used to key inter-population draws
+
+    EnsembleStatistics* ensemble;        // Receives the daily counts during runMultipleSimulations
+    std::uint64_t personDays;            // Individuals x days simulated so far, including replicates
+    PhaseProfile profile;                // Per-phase timings, recorded only when enabled
+    std::string timingCsvFilename;       // Optional per-day timing output
+
+    // Model in effect on the given day: one bounds check and load per day
+    const DiseaseModel& modelForDay(int day) const {
+        return static_cast<std::size_t>(day) < dailyModels.size() ? dailyModels[day] : model;
+    }
+
+    // Print the phase timing table (and write the daily CSV) if timing is enabled
+    void reportTiming() const;
+
+    // Draw the day's partner populations and contacts (sizeOf gives population sizes) and
+    // visit every contact pair as (pop1, person1, pop2, person2, draw), draw() giving the
+    // random bits of the contact's transmission decision
+    template <typename SizeOf, typename Visit>
+    void forEachInterPopulationContact(SizeOf sizeOf, Visit visit);
+    template <typename Draws, typename SizeOf, typename Visit>
+    void drawInterPopulationContacts(Draws& draws, SizeOf& sizeOf, Visit& visit);
+
+    // Infect a contacted person if the transmission draw succeeds for their state under the
+    // day's model (and vaccine handling), decided as within a population; returns whether
+    // they were infected
+    bool infectByContact(Population& pop, int person, std::uint64_t draw, const DiseaseModel& today);
+
+    // Contacts of infectious people in this process's populations, for processes holding only some
+    // of them; needs common random numbers so every process draws the same contacts
+    void collectInterPopulationInfections(const std::vector<int>& sizes,
+                                          std::vector<ContactInfection>& infections);
+
+    // Spread, progress, apply and count one population's day (timed per phase)
+    StateCounts simulatePopulationDay(Population& pop, const DiseaseModel& today);
+
+    int threadCount = 1;                 // Threads for the populations of a day
+    bool replicateDetails = false;       // Write the daily rows of every replicate to its own file
+    std::unique_ptr<WorkerPool> workerPool; // Their threads, started on the first parallel day
+    std::vector<int> lastInfectious;     // Infectious count of every population the previous day
+    std::vector<std::unique_ptr<PerfCounters>> workerCounters; // Opened on each pool thread by --perf-counters
+
+    // The day of every population on threadCount threads: chunks of the spread and progress
+    // phases are scheduled by work stealing with costs from the previous day's infectious
+    // counts, then every population applies its infections and is counted. The workers'
+    // generators aren't seeded, so a run without common random numbers switches to keyed
+    // draws on its first parallel day, keyed from the calling thread's generator.
+    std::vector<StateCounts> simulatePopulationsParallel(const DiseaseModel& today);
+
+    friend class DistributedSimulation;
+
+    // Day loop of the single-population fast path: no phase timing, tracing, ensemble or
+    // inter-population work; rows are only counted and written when dailyRows is set.
+    // Returns the number of days until no one is infectious.
+    int runSinglePopulation(Population& pop, std::ostream* dailyRows);
+
+    // Run to extinction writing the daily rows to detailsFilename (discarded if empty),
+    // without console output
+    void runToEnd(const std::string& detailsFilename);
+
+    // Back to the initial states with one index case per population, as every replicate
+    // starts; keyed runs switch to the streams of replicateKey first, so the index cases and
+    // all draws differ between replicates
+    void restartRun(bool keyed, std::uint64_t replicateKey);
+
+    // Run replicates firstRun .. firstRun + count - 1 from initialPopulations on a thread pool
+    void runReplicateBatch(const std::vector<Population>& initialPopulations, int firstRun, int count,
+                           int replicateThreads, unsigned int baseSeed, EnsembleStatistics& statistics);
+
+    // Print the mean / std dev table of the final compartment sizes
+    void printEnsembleSummary(const EnsembleStatistics& statistics) const;
 
      //  function to calculate standard deviation
     double calculateStandardDeviation(const std::vector<double>& data, double mean) const;
@@ -60,15 +276,105 @@ std::vector<Population> populations;
     // Constructor
     Simulation(const std::vector<Population>& populations, int diseaseDuration, double transmissibility);
 
+    // Constructor taking over the populations without copying them
+    Simulation(std::vector<Population>&& populations, int diseaseDuration, double transmissibility);
+    Simulation(std::vector<Population>&& populations, const DiseaseModel& model);
+
+    const DiseaseModel& getModel() const { return model; }
+
+    // Replace the disease model, e.g. for the next point of a sweep; a compiled intervention
+    // schedule belongs to the old model and is dropped
+    void setModel(const DiseaseModel& newModel) {
+        model = newModel;
+        dailyModels.clear();
+    }
+
+    // Change how likely a population is chosen for inter-population contacts; only the
+    // partner table entry is updated
+    void setMobility(int population, double mobility);
+
+    // Simulate the populations of each day on this many threads (1 = serial). Large
+    // populations are split into chunks idle threads can steal. Parallel days always draw
+    // keyed numbers, so a seeded run gives the same rows every time, and runs with common
+    // random numbers the same rows for any thread count.
+    void setThreads(int threads) { threadCount = std::max(1, threads); }
+
+    // Double-buffered state for every population (see Population::setDoubleBuffered)
+    void setDoubleBuffered(bool enabled);
+
+    // Compile an intervention schedule over this simulation's model into the per-day table
+    void setInterventions(const std::vector<InterventionRule>& rules);
+
    
 void simulateInterPopulationContacts();
+
+    // Common random numbers: key every draw of this replicate by (replicate, population,
+    // person, day, contact slot) so different parameter values share the same randomness.
+    // Keyed draws ignore seedRandomGenerator: replicates r of runMultipleSimulations and
+    // runAdaptiveSimulations use the key combineKeys(baseSeed, r) and branches streams
+    // derived from this one.
+    void useCommonRandomNumbers(std::uint64_t replicate);
     // Run the simulation for multi-population experiments
     void start(const std::string& detailsFilename);
 
-    // Run the simulation for single population experiment
-    void startSinglePopulationExperiment();
+    // Advance all populations by one day and append the daily rows to outputFile.
+    // Returns true while infectious individuals remain.
+    bool simulateNextDay(std::ostream& outputFile);
+
+    // Run the shared prefix up to branchDay, then fork branchCount child processes
+    // that continue from that snapshot with copy-on-write population state and
+    // distinct random streams (baseSeed + branch + 1, or keyed streams of their own
+    // with common random numbers). configureBranch may change
+    // the policy of each branch before it continues. Returns the number of failed branches.
+    int runBranches(int branchDay, int branchCount, unsigned int baseSeed,
+                    const std::string& filenamePrefix,
+                    const std::function<void(Simulation&, int)>& configureBranch = nullptr);
+
+    int getDayCount() const { return dayCount; }
+
+    // Append one Day,Population,Susceptible,Infectious,Recovered,Vaccinated row
+    static void writeDailyRow(std::ostream& outputFile, int day, const std::string& name,
+                              int susceptible, int infectious, int recovered, int vaccinated);
+
+    // Header and rows of the daily CSV with the columns of the model's states
+    // (an Exposed column after Susceptible for latent-period models)
+    static std::string dailyHeader(const DiseaseModel& model);
+    static void writeDailyRow(std::ostream& outputFile, int day, const std::string& name,
+                              const StateCounts& counts, const DiseaseModel& model);
+
+    // Single-population fast path on populations[0] with this simulation's disease model. One run writes the daily trajectory to filename; more runs restart
+    // from the vaccination state with a new index case each and write one row with the final
+    // counts per run.
+    void startSinglePopulationExperiment(const std::string& filename = "single_population_results.csv",
+                                         int runs = 1);
+
+    // Run several simulations from the same initial state: every run resets the populations to
+    // their vaccination rate and places one index case each. With replicateThreads > 1 the
+    // runs are independent replicates on a thread pool, run r seeded with baseSeed + r.
+    void runMultipleSimulations(int runs, int replicateThreads = 1, unsigned int baseSeed = 0);
+
+    // Also write the daily rows of replicate r to disease_details_run_<r + 1>.csv in
+    // runMultipleSimulations and runAdaptiveSimulations (off by default)
+    void setReplicateDetails(bool enabled) { replicateDetails = enabled; }
+
+    // Time the phases of every simulated day; summaries are printed at the end of
+    // start / runMultipleSimulations and, if a filename is given, written per day
+    void enableTiming(const std::string& dailyCsvFilename = "");
+    const PhaseProfile& getProfile() const { return profile; }
+
+    // Also count cycles, instructions, LLC, branch and dTLB misses per phase with
+    // perf_event_open (implies timing). Returns false if the counters are unavailable.
+    bool enableHardwareCounters();
+
+    // Individuals x days simulated so far (throughput accounting)
+    std::uint64_t getPersonDays() const { return personDays; }
 
-    void runMultipleSimulations(int runs);
+    // Target-precision mode: run replicates in parallel batches of batchSize until the
+    // confidence interval half-width of every population's final recovered count is
+    // at most targetHalfWidth (at least minRuns, at most maxRuns replicates).
+    // Replicate r is seeded with baseSeed + r. Returns the number of runs performed.
+    int runAdaptiveSimulations(double targetHalfWidth, double confidence, int minRuns, int maxRuns,
+                               int batchSize, int replicateThreads, unsigned int baseSeed);
     void writeSummaryStatistics(const std::string& statsFilename); // Updated to accept a filename
 
      
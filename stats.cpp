@@ -0,0 +1,278 @@
+#include "stats.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <utility>
+
+// ----- RunningStatistics Implementation -----
+void RunningStatistics::add(double value) {
+    n++;
+    double delta = value - average;
+    average += delta / n;
+    m2 += delta * (value - average);
+}
+
+void RunningStatistics::merge(const RunningStatistics& other) {
+    if (other.n == 0) return;
+    if (n == 0) {
+        *this = other;
+        return;
+    }
+    // Chan et al. parallel combination
+    std::uint64_t total = n + other.n;
+    double delta = other.average - average;
+    average += delta * other.n / total;
+    m2 += other.m2 + delta * delta * (static_cast<double>(n) * other.n / total);
+    n = total;
+}
+
+double RunningStatistics::variance() const {
+    return n > 0 ? m2 / n : 0.0;
+}
+
+double RunningStatistics::sampleVariance() const {
+    return n > 1 ? m2 / (n - 1) : 0.0;
+}
+
+double RunningStatistics::stdDev() const {
+    return std::sqrt(variance());
+}
+
+// Inverse of the standard normal CDF (Acklam's rational approximation)
+static double normalQuantile(double p) {
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                               1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                               6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                               -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                               3.754408661907416e+00};
+    const double low = 0.02425;
+
+    if (p < low) {
+        double q = std::sqrt(-2 * std::log(p));
+        return (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+               ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+    }
+    if (p > 1 - low) {
+        return -normalQuantile(1 - p);
+    }
+    double q = p - 0.5;
+    double r = q * q;
+    return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+           (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+}
+
+double confidenceHalfWidth(const RunningStatistics& statistics, double confidence) {
+    if (statistics.count() < 2) {
+        return std::numeric_limits<double>::infinity();
+    }
+    double z = normalQuantile(0.5 + std::clamp(confidence, 0.0, 0.999999) / 2.0);
+    return z * std::sqrt(statistics.sampleVariance() / statistics.count());
+}
+
+// ----- QuantileSketch Implementation -----
+QuantileSketch::QuantileSketch(int k) : k(std::max(8, k)), coinState(0x9e3779b9u), levels(1) {}
+
+int QuantileSketch::capacity(size_t level) const {
+    // Lower levels shrink geometrically by 2/3 relative to the top level
+    size_t depth = levels.size() - 1 - level;
+    return std::max(2, static_cast<int>(std::ceil(k * std::pow(2.0 / 3.0, depth))));
+}
+
+void QuantileSketch::add(float value) {
+    levels[0].push_back(value);
+    n++;
+    compress();
+}
+
+void QuantileSketch::compact(size_t level) {
+    if (level + 1 == levels.size()) {
+        levels.emplace_back();
+    }
+    auto& items = levels[level];
+    std::sort(items.begin(), items.end());
+
+    // Keep one item behind if the count is odd, promote every other item of the rest
+    float leftover = 0.0f;
+    bool hasLeftover = items.size() % 2 == 1;
+    if (hasLeftover) {
+        leftover = items.back();
+        items.pop_back();
+    }
+
+    coinState ^= coinState << 13;
+    coinState ^= coinState >> 17;
+    coinState ^= coinState << 5;
+    size_t offset = coinState & 1u;
+
+    auto& next = levels[level + 1];
+    for (size_t i = offset; i < items.size(); i += 2) {
+        next.push_back(items[i]);
+    }
+    items.clear();
+    if (hasLeftover) {
+        items.push_back(leftover);
+    }
+}
+
+void QuantileSketch::compress() {
+    for (size_t level = 0; level < levels.size(); ++level) {
+        if (static_cast<int>(levels[level].size()) >= capacity(level)) {
+            compact(level);
+        }
+    }
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+    if (other.levels.size() > levels.size()) {
+        levels.resize(other.levels.size());
+    }
+    for (size_t level = 0; level < other.levels.size(); ++level) {
+        levels[level].insert(levels[level].end(), other.levels[level].begin(), other.levels[level].end());
+    }
+    n += other.n;
+    compress();
+}
+
+double QuantileSketch::quantile(double q) const {
+    std::vector<std::pair<float, std::uint64_t>> weighted;
+    for (size_t level = 0; level < levels.size(); ++level) {
+        for (float value : levels[level]) {
+            weighted.emplace_back(value, std::uint64_t(1) << level);
+        }
+    }
+    if (weighted.empty()) return 0.0;
+
+    std::sort(weighted.begin(), weighted.end());
+    std::uint64_t total = 0;
+    for (const auto& item : weighted) total += item.second;
+
+    double target = std::clamp(q, 0.0, 1.0) * total;
+    std::uint64_t cumulative = 0;
+    for (const auto& item : weighted) {
+        cumulative += item.second;
+        if (cumulative >= target) {
+            return item.first;
+        }
+    }
+    return weighted.back().first;
+}
+
+// ----- EnsembleStatistics Implementation -----
+const char* compartmentName(Compartment compartment) {
+    switch (compartment) {
+        case Compartment::Susceptible: return "Susceptible";
+        case Compartment::Infectious: return "Infectious";
+        case Compartment::Recovered: return "Recovered";
+        case Compartment::Vaccinated: return "Vaccinated";
+    }
+    return "Unknown";
+}
+
+void EnsembleStatistics::Cell::add(double value) {
+    moments.add(value);
+    sketch.add(static_cast<float>(value));
+}
+
+void EnsembleStatistics::Cell::merge(const Cell& other) {
+    moments.merge(other.moments);
+    sketch.merge(other.sketch);
+}
+
+EnsembleStatistics::EnsembleStatistics(const std::vector<std::string>& populationNames, int sketchSize)
+    : names(populationNames), sketchSize(sketchSize),
+      finished(populationNames.size() * compartmentCount, Cell(sketchSize)),
+      current(populationNames.size()) {}
+
+size_t EnsembleStatistics::cellIndex(size_t population, Compartment compartment) const {
+    return population * compartmentCount + static_cast<size_t>(compartment);
+}
+
+void EnsembleStatistics::beginRun() {
+    currentDay = 0;
+    std::fill(current.begin(), current.end(), Counts{});
+}
+
+void EnsembleStatistics::record(int day, size_t population, const Counts& counts) {
+    if (day > maxDay()) {
+        // Every earlier run has already ended, so the new day starts from their final values
+        days.resize(day, finished);
+    }
+    CellVector& cells = days[day - 1];
+    for (int c = 0; c < compartmentCount; ++c) {
+        cells[population * compartmentCount + c].add(counts[c]);
+    }
+    current[population] = counts;
+    currentDay = std::max(currentDay, day);
+}
+
+void EnsembleStatistics::endRun() {
+    // Carry the final state of this run forward over the days other runs lasted longer
+    for (int day = currentDay + 1; day <= maxDay(); ++day) {
+        CellVector& cells = days[day - 1];
+        for (size_t p = 0; p < current.size(); ++p) {
+            for (int c = 0; c < compartmentCount; ++c) {
+                cells[p * compartmentCount + c].add(current[p][c]);
+            }
+        }
+    }
+    for (size_t p = 0; p < current.size(); ++p) {
+        for (int c = 0; c < compartmentCount; ++c) {
+            finished[p * compartmentCount + c].add(current[p][c]);
+        }
+    }
+    runs++;
+}
+
+void EnsembleStatistics::merge(const EnsembleStatistics& other) {
+    // Past the end of an ensemble its runs are represented by their final values
+    int newMax = std::max(maxDay(), other.maxDay());
+    if (maxDay() < newMax) {
+        days.resize(newMax, finished);
+    }
+    for (int d = 0; d < newMax; ++d) {
+        const CellVector& source = d < other.maxDay() ? other.days[d] : other.finished;
+        for (size_t i = 0; i < source.size(); ++i) {
+            days[d][i].merge(source[i]);
+        }
+    }
+    for (size_t i = 0; i < finished.size(); ++i) {
+        finished[i].merge(other.finished[i]);
+    }
+    runs += other.runs;
+}
+
+const RunningStatistics& EnsembleStatistics::finalStatistics(size_t population, Compartment compartment) const {
+    return finished[cellIndex(population, compartment)].moments;
+}
+
+void EnsembleStatistics::writeBands(const std::string& filename) const {
+    ScopedTrace trace("writeBands", "output", filename);
+    std::ofstream bandsFile(filename);
+    if (!bandsFile.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << " for writing ensemble bands.\n";
+        return;
+    }
+
+    bandsFile << "Day,Population,Compartment,Mean,StdDev,P05,P50,P95\n";
+    for (size_t d = 0; d < days.size(); ++d) {
+        for (size_t p = 0; p < names.size(); ++p) {
+            for (int c = 0; c < compartmentCount; ++c) {
+                const Cell& cell = days[d][p * compartmentCount + c];
+                bandsFile << d + 1 << ","
+                          << names[p] << ","
+                          << compartmentName(static_cast<Compartment>(c)) << ","
+                          << cell.moments.mean() << ","
+                          << cell.moments.stdDev() << ","
+                          << cell.sketch.quantile(0.05) << ","
+                          << cell.sketch.quantile(0.50) << ","
+                          << cell.sketch.quantile(0.95) << "\n";
+            }
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "memory.h"
+
+// Streaming mean and variance (Welford's algorithm), mergeable across runs and threads
+class RunningStatistics {
+public:
+    void add(double value);
+    void merge(const RunningStatistics& other);
+
+    std::uint64_t count() const { return n; }
+    double mean() const { return n > 0 ? average : 0.0; }
+    double variance() const;        // Population variance, as used by the run summaries
+    double sampleVariance() const;  // Unbiased estimate, for confidence intervals
+    double stdDev() const;
+
+private:
+    std::uint64_t n = 0;
+    double average = 0.0;
+    double m2 = 0.0;
+};
+
+// Half-width of the normal-approximation confidence interval of the mean
+double confidenceHalfWidth(const RunningStatistics& statistics, double confidence);
+
+// Mergeable quantile sketch (KLL). Memory stays O(k log(n/k)) however many values are
+// added; the rank error is roughly 1.7 / k.
+class QuantileSketch {
+public:
+    explicit QuantileSketch(int k = 128);
+
+    void add(float value);
+    void merge(const QuantileSketch& other);
+
+    std::uint64_t count() const { return n; }
+    double quantile(double q) const;  // q in [0, 1]
+
+private:
+    int k;
+    std::uint64_t n = 0;
+    std::uint32_t coinState;                  // Private coin flips, never touches the simulation RNG
+    std::vector<TrackedVector<float, MemoryCategory::Statistics>> levels; // Items on level h carry weight 2^h
+
+    int capacity(size_t level) const;
+    void compress();
+    void compact(size_t level);
+};
+
+// Compartments reported per population and day
+enum class Compartment { Susceptible, Infectious, Recovered, Vaccinated };
+constexpr int compartmentCount = 4;
+const char* compartmentName(Compartment compartment);
+
+// Streaming statistics of an ensemble of runs, per population, compartment and day,
+// without retaining the individual trajectories. Runs that end early contribute
+// their final state to all later days.
+class EnsembleStatistics {
+public:
+    using Counts = std::array<int, compartmentCount>;
+
+    EnsembleStatistics(const std::vector<std::string>& populationNames, int sketchSize = 128);
+
+    void beginRun();
+    void record(int day, size_t population, const Counts& counts);
+    void endRun();
+
+    // Combine with an ensemble of other runs over the same populations (no run in progress)
+    void merge(const EnsembleStatistics& other);
+
+    int runCount() const { return runs; }
+    int maxDay() const { return static_cast<int>(days.size()); }
+
+    // Statistics of the value at the end of each run
+    const RunningStatistics& finalStatistics(size_t population, Compartment compartment) const;
+
+    // Day,Population,Compartment,Mean,StdDev,P05,P50,P95
+    void writeBands(const std::string& filename) const;
+
+private:
+    struct Cell {
+        RunningStatistics moments;
+        QuantileSketch sketch;
+        explicit Cell(int sketchSize) : sketch(sketchSize) {}
+        void add(double value);
+        void merge(const Cell& other);
+    };
+
+    std::vector<std::string> names;
+    int sketchSize;
+    int runs = 0;
+    using CellVector = TrackedVector<Cell, MemoryCategory::Statistics>;
+
+    std::vector<CellVector> days;          // days[d - 1][population * compartmentCount + compartment]
+    CellVector finished;                   // Final values of all completed runs
+    std::vector<Counts> current;           // Latest counts of the run in progress
+    int currentDay = 0;
+
+    size_t cellIndex(size_t population, Compartment compartment) const;
+};
+
+#endif // STATS_H
@@ -0,0 +1,167 @@
+#include "sweep.h"
+#include "simulation.h"
+#include "parallel.h"
+#include "random.h"
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+std::vector<double> parseSweepRange(const std::string& text, double defaultValue) {
+    if (text.empty()) {
+        return {defaultValue};
+    }
+
+    size_t first = text.find(':');
+    if (first == std::string::npos) {
+        return {std::stod(text)};
+    }
+    size_t second = text.find(':', first + 1);
+    double start = std::stod(text.substr(0, first));
+    double stop = std::stod(text.substr(first + 1, second - first - 1));
+    double step = second == std::string::npos ? 1.0 : std::stod(text.substr(second + 1));
+    if (step <= 0.0 || stop < start) {
+        return {start};
+    }
+
+    // Small tolerance so that e.g. 0:1:0.1 includes 1.0 despite rounding
+    int count = static_cast<int>(std::floor((stop - start) / step + 1e-9)) + 1;
+    std::vector<double> values;
+    for (int i = 0; i < count; ++i) {
+        values.push_back(start + i * step);
+    }
+    return values;
+}
+
+ParameterSweep::ParameterSweep(const std::vector<PopulationSpec>& populations,
+                               const std::vector<double>& vaccinationRates,
+                               const std::vector<double>& transmissibilities,
+                               const std::vector<int>& durations,
+                               int replicates)
+    : populations(populations), replicates(std::max(1, replicates)) {
+    for (double vaccinationRate : vaccinationRates) {
+        for (double transmissibility : transmissibilities) {
+            for (int duration : durations) {
+                points.push_back({vaccinationRate, transmissibility, duration});
+            }
+        }
+    }
+}
+
+ParameterSweep ParameterSweep::fromConfig(const INIReader& reader, const std::vector<PopulationSpec>& populations) {
+    std::vector<double> vaccinationRates = parseSweepRange(reader.Get("sweep", "vaccination_rate", ""), 0.0);
+    std::vector<double> transmissibilities = parseSweepRange(
+        reader.Get("sweep", "transmissibility", ""), reader.GetReal("disease", "transmissibility", 0.15));
+
+    std::vector<int> durations;
+    for (double duration : parseSweepRange(reader.Get("sweep", "duration", ""),
+                                           reader.GetInteger("disease", "duration", 3))) {
+        durations.push_back(static_cast<int>(std::lround(duration)));
+    }
+
+    int replicates = reader.GetInteger("sweep", "replicates", 1);
+    ParameterSweep sweep(populations, vaccinationRates, transmissibilities, durations, replicates);
+    sweep.setBaseModel(readDiseaseModel(reader));
+    sweep.setCommonRandomNumbers(reader.GetBoolean("sweep", "common_random_numbers", false));
+    return sweep;
+}
+
+std::vector<SweepResult> ParameterSweep::run(int threadCount, unsigned int baseSeed) const {
+    int taskCount = static_cast<int>(points.size()) * replicates;
+    std::vector<int> recovered(taskCount);
+    std::vector<int> days(taskCount);
+
+    // One simulation per worker; its populations are reset in place for every task
+    threadCount = std::max(1, std::min(threadCount, taskCount));
+    std::vector<std::unique_ptr<Simulation>> workers(threadCount);
+
+    parallelFor(taskCount, threadCount, [&](int task, int worker) {
+        const SweepPoint& point = points[task / replicates];
+        DiseaseModel model = baseModel;
+        model.duration = point.diseaseDuration;
+        model.setTransmissibility(point.transmissibility);
+
+        if (!workers[worker]) {
+            std::vector<Population> initial;
+            for (const auto& spec : populations) {
+                initial.emplace_back(spec.name, spec.size, point.vaccinationRate, spec.ages);
+                initial.back().mobility = spec.mobility;
+            }
+            workers[worker] = std::make_unique<Simulation>(std::move(initial), model);
+        }
+        Simulation& sim = *workers[worker];
+        sim.setModel(model); // Inter-population contacts use the simulation's model
+
+        for (auto& pop : sim.populations) {
+            pop.reset(point.vaccinationRate);
+        }
+        if (commonRandomNumbers) {
+            sim.useCommonRandomNumbers(combineKeys(baseSeed, task % replicates));
+        } else {
+            seedRandomGenerator(baseSeed + static_cast<unsigned int>(task));
+        }
+        for (auto& pop : sim.populations) {
+            pop.initializeInfection();
+        }
+
+        int dayCount = 0;
+        bool hasInfectious = true;
+        while (hasInfectious && (model.maxDays <= 0 || dayCount < model.maxDays)) {
+            dayCount++;
+            hasInfectious = false;
+            for (auto& pop : sim.populations) {
+                pop.simulateDay(model);
+                StateCounts counts = pop.countStates();
+                if (counts[static_cast<int>(State::Infectious)] + counts[static_cast<int>(State::Exposed)] > 0) {
+                    hasInfectious = true;
+                }
+            }
+            sim.simulateInterPopulationContacts();
+        }
+
+        int totalRecovered = 0;
+        for (const auto& pop : sim.populations) {
+            totalRecovered += pop.countByState(State::Recovered);
+        }
+        recovered[task] = totalRecovered;
+        days[task] = dayCount;
+    });
+
+    std::vector<SweepResult> results;
+    for (size_t p = 0; p < points.size(); ++p) {
+        double sum = 0.0, sumDays = 0.0;
+        for (int r = 0; r < replicates; ++r) {
+            sum += recovered[p * replicates + r];
+            sumDays += days[p * replicates + r];
+        }
+        double mean = sum / replicates;
+        double variance = 0.0;
+        for (int r = 0; r < replicates; ++r) {
+            double diff = recovered[p * replicates + r] - mean;
+            variance += diff * diff;
+        }
+        variance /= replicates;
+        results.push_back({points[p], replicates, mean, std::sqrt(variance), sumDays / replicates});
+    }
+    return results;
+}
+
+void ParameterSweep::writeResults(const std::vector<SweepResult>& results, const std::string& filename) {
+    std::ofstream outputFile(filename);
+    if (!outputFile.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << " for writing sweep results.\n";
+        return;
+    }
+
+    outputFile << "RecoveredCount,Vaccinationrate,Transmissibility,Duration,Replicates,RecoveredStdDev,MeanDays\n";
+    for (const auto& result : results) {
+        outputFile << result.meanRecovered << ","
+                   << result.point.vaccinationRate << ","
+                   << result.point.transmissibility << ","
+                   << result.point.diseaseDuration << ","
+                   << result.replicates << ","
+                   << result.stdDevRecovered << ","
+                   << result.meanDays << "\n";
+    }
+    std::cout << "Sweep results written to " << filename << "\n";
+}
@@ -0,0 +1,65 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "config.h"
+#include <string>
+#include <vector>
+
+// Values of one swept parameter, given as "start:stop:step" or a single value
+std::vector<double> parseSweepRange(const std::string& text, double defaultValue);
+
+// One point of the parameter grid
+struct SweepPoint {
+    double vaccinationRate;
+    double transmissibility;
+    int diseaseDuration;
+};
+
+// Aggregated outcome of all replicates of one grid point
+struct SweepResult {
+    SweepPoint point;
+    int replicates;
+    double meanRecovered;   // Recovered individuals summed over all populations
+    double stdDevRecovered;
+    double meanDays;
+};
+
+// Runs the Cartesian grid of vaccination rate x transmissibility x duration
+// for the configured populations, with every grid point x replicate scheduled
+// as an independent task on a thread pool.
+class ParameterSweep {
+public:
+    ParameterSweep(const std::vector<PopulationSpec>& populations,
+                   const std::vector<double>& vaccinationRates,
+                   const std::vector<double>& transmissibilities,
+                   const std::vector<int>& durations,
+                   int replicates);
+
+    // Build the sweep from the [sweep] section of the configuration
+    static ParameterSweep fromConfig(const INIReader& reader, const std::vector<PopulationSpec>& populations);
+
+    // Run every grid point x replicate. Task t is seeded with baseSeed + t, or with
+    // common random numbers every replicate r is keyed by (baseSeed, r).
+    std::vector<SweepResult> run(int threadCount, unsigned int baseSeed) const;
+
+    // Write one consolidated table; the first two columns match plott.gp
+    static void writeResults(const std::vector<SweepResult>& results, const std::string& filename);
+
+    // Model every grid point starts from before its duration and transmissibility are set
+    void setBaseModel(const DiseaseModel& model) { baseModel = model; }
+
+    // Replicate r of every grid point uses the same keyed random numbers
+    void setCommonRandomNumbers(bool enabled) { commonRandomNumbers = enabled; }
+
+    const std::vector<SweepPoint>& getPoints() const { return points; }
+    int getReplicates() const { return replicates; }
+
+private:
+    std::vector<PopulationSpec> populations;
+    std::vector<SweepPoint> points;
+    int replicates;
+    DiseaseModel baseModel;
+    bool commonRandomNumbers = false;
+};
+
+#endif // SWEEP_H
@@ -2,6 +2,22 @@
 #include "../include/doctest.h"
 #include "simulation.h"
 #include "INIReader.h"
+#include "sweep.h"
+#include "random.h"
+#include "config.h"
+#include "parallel.h"
+#include "stats.h"
+#include "trace.h"
+#include "perf_counters.h"
+#include "memory.h"
+#include "estimator.h"
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
 
 // Test the Simulation Class
 TEST_CASE("Simulation Class Testing") {
@@ -125,6 +141,23 @@ TEST_CASE("Population Simulation Edge Cases") {
 
     
     CHECK(true); // Add additional checks for correctness if you parse results programmatically.
+
+    // Every run starts with exactly one index case, also when one was placed beforehand;
+    // without transmission it is the only one to recover
+    Population index("Population1", 100, 0.0);
+    index.initializeInfection();
+    Simulation noSpread(std::vector<Population>{index}, 1, 0.0);
+    noSpread.setReplicateDetails(true);
+    for (int threads : {1, 2}) {
+        noSpread.runMultipleSimulations(3, threads, 5);
+        for (int run = 1; run <= 3; ++run) {
+            std::ifstream details("disease_details_run_" + std::to_string(run) + ".csv");
+            std::string header, row;
+            std::getline(details, header);
+            std::getline(details, row);
+            CHECK(row.substr(row.rfind(',', row.rfind(',') - 1)) == ",1,0"); // Recovered, Vaccinated
+        }
+    }
 }
 /*TEST_CASE("CSV File Generation") {
     Population pop1("Population1", 100, 0.10);
@@ -143,3 +176,892 @@ TEST_CASE("Population Simulation Edge Cases") {
     detailsFile.close();
     statsFile.close();
 }*/
+
+TEST_CASE("Scenario Branching") {
+    auto initialPopulations = [] {
+        seedRandomGenerator(7);
+        Population pop1("Population1", 2000, 0.10);
+        Population pop2("Population2", 3000, 0.20);
+        pop1.initializeInfection();
+        pop2.initializeInfection();
+        return std::vector<Population>{pop1, pop2};
+    };
+    auto readFile = [](const std::string& filename) {
+        std::ifstream file(filename);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    };
+
+    // The same days without branching
+    Simulation straight(initialPopulations(), 5, 0.4);
+    std::ostringstream straightRows;
+    straightRows << Simulation::dailyHeader(straight.getModel());
+    for (int day = 0; day < 3; ++day) {
+        CHECK(straight.simulateNextDay(straightRows));
+    }
+
+    Simulation simulation(initialPopulations(), 5, 0.4);
+    int failed = simulation.runBranches(3, 4, 7, "test_branching");
+
+    CHECK(failed == 0);
+    CHECK(simulation.getDayCount() == 3); // The parent only runs the shared prefix
+    CHECK(readFile("test_branching_prefix.csv") == straightRows.str());
+
+    // Every branch continues from the day after the prefix with its own random stream
+    std::vector<std::string> branchRows;
+    for (int branch = 0; branch < 4; ++branch) {
+        std::string rows = readFile("test_branching_branch_" + std::to_string(branch) + ".csv");
+        std::string header = Simulation::dailyHeader(simulation.getModel());
+        CHECK(rows.compare(0, header.size() + 2, header + "4,") == 0);
+        branchRows.push_back(rows);
+    }
+    std::sort(branchRows.begin(), branchRows.end());
+    CHECK(std::unique(branchRows.begin(), branchRows.end()) - branchRows.begin() >= 2);
+
+    // Keyed draws ignore the branch seeds; branches still continue on streams of their own
+    Simulation keyedStraight(initialPopulations(), 5, 0.4);
+    keyedStraight.useCommonRandomNumbers(7);
+    std::ostringstream keyedRows;
+    keyedRows << Simulation::dailyHeader(keyedStraight.getModel());
+    for (int day = 0; day < 3; ++day) {
+        CHECK(keyedStraight.simulateNextDay(keyedRows));
+    }
+
+    Simulation keyed(initialPopulations(), 5, 0.4);
+    keyed.useCommonRandomNumbers(7);
+    CHECK(keyed.runBranches(3, 4, 7, "test_branching_keyed") == 0);
+    CHECK(readFile("test_branching_keyed_prefix.csv") == keyedRows.str());
+    branchRows.clear();
+    for (int branch = 0; branch < 4; ++branch) {
+        branchRows.push_back(readFile("test_branching_keyed_branch_" + std::to_string(branch) + ".csv"));
+    }
+    std::sort(branchRows.begin(), branchRows.end());
+    CHECK(std::unique(branchRows.begin(), branchRows.end()) - branchRows.begin() >= 2);
+}
+
+TEST_CASE("Parameter Sweep") {
+    SUBCASE("Range Parsing") {
+        CHECK(parseSweepRange("", 0.15).size() == 1);
+        CHECK(parseSweepRange("0.3", 0.0)[0] == doctest::Approx(0.3));
+        std::vector<double> rates = parseSweepRange("0.0:1.0:0.1", 0.0);
+        CHECK(rates.size() == 11);
+        CHECK(rates.back() == doctest::Approx(1.0));
+    }
+
+    SUBCASE("Grid Run") {
+        std::vector<PopulationSpec> specs = {{"Population1", 200, 0.0}, {"Population2", 100, 0.0}};
+        ParameterSweep sweep(specs, {0.0, 1.0}, {0.15, 0.3}, {3}, 2);
+        CHECK(sweep.getPoints().size() == 4);
+
+        std::vector<SweepResult> results = sweep.run(2, 11);
+        CHECK(results.size() == 4);
+        for (const auto& result : results) {
+            CHECK(result.replicates == 2);
+            if (result.point.vaccinationRate == 1.0) {
+                CHECK(result.meanRecovered <= 2.0); // Only the two index cases recover
+            }
+        }
+    }
+}
+
+TEST_CASE("Common Random Numbers") {
+    SUBCASE("Same Stream Gives Same Epidemic") {
+        Population pop1("Population1", 500, 0.0);
+        Population pop2("Population1", 500, 0.0);
+        pop1.useCommonRandomNumbers(42);
+        pop2.useCommonRandomNumbers(42);
+        pop1.initializeInfection();
+        pop2.initializeInfection();
+        for (int day = 0; day < 10; ++day) {
+            pop1.simulateDay(3, 0.3);
+            pop2.simulateDay(3, 0.3);
+            CHECK(pop1.countByState(State::Infectious) == pop2.countByState(State::Infectious));
+        }
+    }
+
+    SUBCASE("Sweep Replicates Share Draws") {
+        std::vector<PopulationSpec> specs = {{"Population1", 300, 0.0}};
+        ParameterSweep sweep(specs, {0.2}, {0.3}, {3}, 2);
+        sweep.setCommonRandomNumbers(true);
+        std::vector<SweepResult> first = sweep.run(1, 5);
+        std::vector<SweepResult> second = sweep.run(2, 5);
+        CHECK(first[0].meanRecovered == second[0].meanRecovered);
+
+        // A point's result doesn't depend on the points a worker ran before it
+        std::vector<PopulationSpec> pair = {{"Population1", 1000, 0.0}, {"Population2", 1000, 0.0}};
+        ParameterSweep closedFirst(pair, {0.0}, {0.0, 1.0}, {30}, 10);
+        ParameterSweep openFirst(pair, {0.0}, {1.0, 0.0}, {30}, 10);
+        closedFirst.setCommonRandomNumbers(true);
+        openFirst.setCommonRandomNumbers(true);
+        std::vector<SweepResult> closed = closedFirst.run(1, 5);
+        std::vector<SweepResult> open = openFirst.run(1, 5);
+        CHECK(closed[0].meanRecovered == doctest::Approx(2.0)); // Only the index cases
+        CHECK(open[1].meanRecovered == closed[0].meanRecovered);
+        CHECK(open[0].meanRecovered == closed[1].meanRecovered);
+    }
+
+    SUBCASE("Keyed Replicates Are Independent") {
+        auto readFile = [](const std::string& filename) {
+            std::ifstream file(filename);
+            return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        };
+        auto runReplicates = [&](int threads) {
+            std::vector<Population> populations;
+            populations.emplace_back("Population1", 2000, 0.1);
+            populations.emplace_back("Population2", 3000, 0.2);
+            Simulation sim(std::move(populations), 5, 0.3);
+            sim.useCommonRandomNumbers(9);
+            sim.setReplicateDetails(true);
+            sim.runMultipleSimulations(2, threads, 9);
+            return std::vector<std::string>{readFile("disease_details_run_1.csv"), readFile("disease_details_run_2.csv")};
+        };
+        std::vector<std::string> serial = runReplicates(1);
+        CHECK(serial[0] != serial[1]);
+        // Replicate r is keyed by (seed, r), whichever way it is run
+        CHECK(runReplicates(2) == serial);
+        CHECK(runReplicates(1) == serial);
+    }
+}
+
+TEST_CASE("Streaming Statistics") {
+    SUBCASE("Welford Matches Direct Computation") {
+        RunningStatistics all, left, right;
+        for (int i = 1; i <= 100; ++i) {
+            all.add(i);
+            (i <= 40 ? left : right).add(i);
+        }
+        left.merge(right);
+        CHECK(all.mean() == doctest::Approx(50.5));
+        CHECK(all.variance() == doctest::Approx(833.25));
+        CHECK(left.mean() == doctest::Approx(all.mean()));
+        CHECK(left.variance() == doctest::Approx(all.variance()));
+    }
+
+    SUBCASE("Quantile Sketch") {
+        QuantileSketch sketch(64), other(64);
+        for (int i = 0; i < 20000; ++i) {
+            (i % 2 ? sketch : other).add(static_cast<float>(i));
+        }
+        sketch.merge(other);
+        CHECK(sketch.count() == 20000);
+        CHECK(sketch.quantile(0.5) == doctest::Approx(10000).epsilon(0.05));
+        CHECK(sketch.quantile(0.95) == doctest::Approx(19000).epsilon(0.05));
+    }
+
+    SUBCASE("Ensemble Carries Final Values Forward") {
+        EnsembleStatistics ensemble({"Population1"});
+        ensemble.beginRun();
+        ensemble.record(1, 0, {10, 1, 0, 0});
+        ensemble.endRun();
+        ensemble.beginRun();
+        ensemble.record(1, 0, {10, 1, 0, 0});
+        ensemble.record(2, 0, {8, 1, 2, 0});
+        ensemble.endRun();
+        CHECK(ensemble.runCount() == 2);
+        CHECK(ensemble.maxDay() == 2);
+        CHECK(ensemble.finalStatistics(0, Compartment::Recovered).mean() == doctest::Approx(1.0));
+    }
+}
+
+TEST_CASE("Adaptive Replicate Count") {
+    Population pop1("Population1", 200, 0.10);
+    Population pop2("Population2", 300, 0.20);
+    std::vector<Population> populations = {pop1, pop2};
+    Simulation simulation(populations, 3, 0.15);
+
+    SUBCASE("Stops At Maximum") {
+        int runs = simulation.runAdaptiveSimulations(1e-9, 0.95, 2, 6, 3, 2, 3);
+        CHECK(runs == 6);
+    }
+
+    SUBCASE("Loose Target Stops Early") {
+        int runs = simulation.runAdaptiveSimulations(1e9, 0.95, 4, 100, 4, 2, 3);
+        CHECK(runs == 4);
+    }
+
+    SUBCASE("Replicate Details Are Opt-In") {
+        std::remove("disease_details_run_1.csv");
+        simulation.runAdaptiveSimulations(1e9, 0.95, 2, 2, 2, 2, 3);
+        CHECK_FALSE(std::ifstream("disease_details_run_1.csv").good());
+        simulation.setReplicateDetails(true);
+        simulation.runAdaptiveSimulations(1e9, 0.95, 2, 2, 2, 2, 3);
+        CHECK(std::ifstream("disease_details_run_1.csv").good());
+    }
+
+    SUBCASE("Confidence Half Width") {
+        RunningStatistics values;
+        for (int i = 0; i < 100; ++i) values.add(i % 2);
+        CHECK(confidenceHalfWidth(values, 0.95) == doctest::Approx(1.96 * std::sqrt(values.sampleVariance() / 100)).epsilon(0.01));
+    }
+}
+
+TEST_CASE("Phase Timing") {
+    Population pop1("Population1", 200, 0.10);
+    Population pop2("Population2", 300, 0.20);
+    pop1.initializeInfection();
+    std::vector<Population> populations = {pop1, pop2};
+
+    SUBCASE("Disabled By Default") {
+        Simulation simulation(populations, 3, 0.15);
+        simulation.start("test_timing_details.csv");
+        CHECK(simulation.getProfile().dayCount() == 0);
+    }
+
+    SUBCASE("Records Every Day") {
+        Simulation simulation(populations, 3, 0.15);
+        simulation.enableTiming("test_timing.csv");
+        simulation.start("test_timing_details.csv");
+        CHECK(simulation.getProfile().dayCount() == simulation.getDayCount());
+        CHECK(simulation.getProfile().total(Phase::Infection) > 0);
+        std::ifstream timingFile("test_timing.csv");
+        CHECK(timingFile.good());
+    }
+}
+
+TEST_CASE("Trace Export") {
+    Population pop1("Population1", 200, 0.10);
+    Population pop2("Population2", 300, 0.20);
+    pop1.initializeInfection();
+    std::vector<Population> populations = {pop1, pop2};
+    Simulation simulation(populations, 3, 0.15);
+
+    // The threaded day records every chunk task with the worker that ran it
+    Simulation threaded(populations, 3, 0.15);
+    threaded.setThreads(2);
+
+    TraceRecorder::instance().enable("test_trace.json");
+    simulation.start("test_trace_details.csv");
+    threaded.start("test_trace_details.csv");
+    TraceRecorder::instance().write();
+    CHECK_FALSE(TraceRecorder::instance().isEnabled());
+
+    std::ifstream traceFile("test_trace.json");
+    std::string content((std::istreambuf_iterator<char>(traceFile)), std::istreambuf_iterator<char>());
+    CHECK(content.find("\"traceEvents\"") != std::string::npos);
+    CHECK(content.find("\"simulateDay\"") != std::string::npos);
+    CHECK(content.find("\"interPopulationContacts\"") != std::string::npos);
+    CHECK(content.find("\"spreadChunk\"") != std::string::npos);
+    CHECK(content.find("worker 0") != std::string::npos);
+}
+
+TEST_CASE("Hardware Counters") {
+    Population pop1("Population1", 200, 0.10);
+    pop1.initializeInfection();
+    std::vector<Population> populations = {pop1};
+    Simulation simulation(populations, 3, 0.15);
+
+    // Counters are often unavailable in containers; timing must keep working either way
+    bool available = simulation.enableHardwareCounters();
+    simulation.start("test_counters_details.csv");
+    CHECK(simulation.getProfile().isEnabled());
+    CHECK(simulation.getProfile().total(Phase::Infection) > 0);
+    if (available) {
+        PerfCounters counters;
+        CHECK(counters.isAvailable());
+    }
+
+    // With several threads the pool threads' counters are added to the same phases
+    Simulation threaded(populations, 3, 0.15);
+    threaded.setThreads(2);
+    threaded.enableHardwareCounters();
+    threaded.start("test_counters_details.csv");
+    CHECK(threaded.getProfile().total(Phase::Infection) > 0);
+}
+
+TEST_CASE("Memory Accounting") {
+    SUBCASE("Population State Is Attributed") {
+        size_t before = MemoryAccounting::current(MemoryCategory::PopulationState);
+        {
+            Population pop("Accounted", 10000, 0.1);
+            CHECK(MemoryAccounting::current(MemoryCategory::PopulationState) >= before + 10000 * sizeof(Person));
+            CHECK(MemoryAccounting::peak(MemoryCategory::PopulationState) >= before + 10000 * sizeof(Person));
+        }
+        CHECK(MemoryAccounting::current(MemoryCategory::PopulationState) == before);
+    }
+
+    SUBCASE("Dry Run Estimate") {
+        std::ofstream config("test_memory.ini");
+        config << "[global]\nnum_populations = 2\nsimulation_runs = 1\n"
+               << "[population_1]\nsize = 1000\n[population_2]\nsize = 3000\n";
+        config.close();
+        INIReader reader("test_memory.ini");
+        MemoryEstimate estimate = estimateMemory(reader);
+        CHECK(estimate.bytes[static_cast<int>(MemoryCategory::PopulationState)] == 4000 * sizeof(Person));
+        CHECK(estimate.bytes[static_cast<int>(MemoryCategory::Statistics)] == 0);
+        CHECK(estimate.total() > 0);
+    }
+}
+
+TEST_CASE("Job Estimate") {
+    std::ofstream config("test_estimate.ini");
+    config << "[global]\nnum_populations = 2\nsimulation_runs = 4\nthreads = 2\n"
+           << "[population_1]\nsize = 2000\n[population_2]\nsize = 8000\nvaccination_rate = 0.2\n";
+    config.close();
+    INIReader reader("test_estimate.ini");
+
+    RunEstimate estimate = estimateRun(reader, 1000);
+    CHECK(estimate.people == 10000);
+    CHECK(estimate.sampleSize == 1000);
+    CHECK(estimate.expectedDays >= estimate.sampleDays);
+    CHECK(estimate.personDaysPerSecond > 0.0);
+    CHECK(estimate.wallSeconds > 0.0);
+    CHECK(estimate.outputBytes > 0);
+}
+
+TEST_CASE("Population Table") {
+    {
+        std::ofstream table("test_populations.csv");
+        table << "name,size,vaccination_rate\n";
+        for (int i = 0; i < 5000; ++i) {
+            table << "District " << i << "," << 100 + i << "," << (i % 10) / 10.0 << "\n";
+        }
+        table << "broken line\n" << "Last, 42 ,0.5";  // No trailing newline
+    }
+
+    std::vector<PopulationSpec> specs = readPopulationTable("test_populations.csv", 4);
+    REQUIRE(specs.size() == 5001);
+    CHECK(specs[0].name == "District 0");
+    CHECK(specs[1234].size == 1334);
+    CHECK(specs[1234].vaccinationRate == doctest::Approx(0.4));
+    CHECK(specs.back().name == "Last");
+    CHECK(specs.back().size == 42);
+
+    std::ofstream config("test_population_table.ini");
+    config << "[global]\npopulation_file = test_populations.csv\nnum_populations = 2\n";
+    config.close();
+    INIReader reader("test_population_table.ini");
+    CHECK(readPopulationSpecs(reader).size() == 5001);
+    CHECK(readPopulationTable("missing_populations.csv").empty());
+}
+
+TEST_CASE("Single Population Fast Path") {
+    Population pop("Single", 3000, 0.1);
+    pop.initializeInfection();
+
+    // Same draws as the general day loop with the same parameters
+    seedRandomGenerator(11);
+    Simulation general(std::vector<Population>{pop}, 3, 0.15);
+    std::ostringstream rows;
+    while (general.simulateNextDay(rows)) {
+    }
+
+    seedRandomGenerator(11);
+    Simulation fast(std::vector<Population>{pop}, 3, 0.15);
+    fast.startSinglePopulationExperiment("test_single_population.csv");
+    CHECK(fast.getDayCount() == general.getDayCount());
+    CHECK(fast.populations[0].countByState(State::Recovered) ==
+          general.populations[0].countByState(State::Recovered));
+
+    Simulation repeated(std::vector<Population>{pop}, 3, 0.15);
+    repeated.startSinglePopulationExperiment("test_single_population_runs.csv", 5);
+    std::ifstream file("test_single_population_runs.csv");
+    std::string line;
+    int lines = 0;
+    while (std::getline(file, line)) lines++;
+    CHECK(lines == 6);
+    CHECK(repeated.getPersonDays() > 0);
+
+    // Every run starts with one index case of its own, not the one placed beforehand
+    Population twoCases("Single", 100, 0.0);
+    twoCases.individuals[0].state = State::Infectious;
+    twoCases.individuals[1].state = State::Infectious;
+    Simulation noSpread(std::vector<Population>{twoCases}, 1, 0.0);
+    noSpread.startSinglePopulationExperiment("test_single_population_runs.csv", 3);
+    std::ifstream runsFile("test_single_population_runs.csv");
+    std::getline(runsFile, line);
+    while (std::getline(runsFile, line)) {
+        CHECK(line.substr(line.rfind(',', line.rfind(',') - 1)) == ",1,0"); // Recovered, Vaccinated
+    }
+}
+
+TEST_CASE("Disease Model Parameters") {
+    // The integer threshold accepts exactly the draws the floating-point compare did
+    for (double t : {0.0, 0.005, 0.15, 0.3, 0.57, 0.999, 1.0}) {
+        DiseaseModel model(3, t);
+        for (int draw = 0; draw <= 100; ++draw) {
+            CHECK((draw < model.transmissionThreshold) == (draw / 100.0 < t));
+        }
+    }
+
+    // Without transmission the index case stays infectious for exactly the configured
+    // duration, on both the specialised and the generic recovery kernel
+    for (int duration = 1; duration <= 15; ++duration) {
+        Population pop("Model", 100, 0.0);
+        pop.initializeInfection();
+        std::vector<Population> populations;
+        populations.push_back(std::move(pop));
+        Simulation sim(std::move(populations), DiseaseModel(duration, 0.0));
+        std::ostringstream rows;
+        while (sim.simulateNextDay(rows)) {
+        }
+        CHECK(sim.getDayCount() == duration);
+        CHECK(sim.populations[0].countByState(State::Recovered) == 1);
+    }
+
+    // Configured contacts and transmissibility reach the kernel (the 20 contacts of this
+    // keyed stream are distinct people, so each sets its own bit)
+    Population pop("Model", 100000, 0.0);
+    pop.useCommonRandomNumbers(2);
+    pop.initializeInfection();
+    pop.spreadInfections(DiseaseModel(3, 1.0, 20));
+    int marked = 0;
+    for (std::uint64_t word : pop.infectedTomorrow) marked += __builtin_popcountll(word);
+    CHECK(marked == 20);
+}
+
+TEST_CASE("Compartment Models") {
+    ModelType type;
+    CHECK(parseModelType("seirs", type));
+    CHECK(type == ModelType::SEIRS);
+    CHECK_FALSE(parseModelType("sis", type));
+
+    SUBCASE("SEIR infections pass through the latent period") {
+        DiseaseModel model(3, 1.0, 10);
+        model.type = ModelType::SEIR;
+        model.latentPeriod = 2;
+        Population pop("Latent", 1000, 0.0);
+        pop.initializeInfection();
+
+        pop.simulateDay(model);
+        StateCounts counts = pop.countStates();
+        CHECK(counts[static_cast<int>(State::Exposed)] > 0);
+        CHECK(counts[static_cast<int>(State::Infectious)] == 1);
+
+        pop.simulateDay(model);
+        CHECK(pop.countByState(State::Infectious) == 1);
+        pop.simulateDay(model);  // Index case recovers, the first exposed turn infectious
+        CHECK(pop.countByState(State::Infectious) == counts[static_cast<int>(State::Exposed)]);
+        CHECK(Simulation::dailyHeader(model).find("Exposed") != std::string::npos);
+    }
+
+    SUBCASE("SEIRS immunity wanes") {
+        DiseaseModel model(2, 0.0);
+        model.type = ModelType::SEIRS;
+        model.immunityDuration = 3;
+        Population pop("Waning", 10, 0.0);
+        pop.initializeInfection();
+        for (int day = 0; day < 2; ++day) pop.simulateDay(model);
+        CHECK(pop.countByState(State::Recovered) == 1);
+        for (int day = 0; day < 3; ++day) pop.simulateDay(model);
+        CHECK(pop.countByState(State::Susceptible) == 10);
+    }
+
+    SUBCASE("SIRV breakthrough infections") {
+        DiseaseModel model(3, 1.0, 10);
+        Population sir("Vaccinated", 1000, 1.0);
+        sir.individuals[0] = Person(State::Infectious);
+        Population sirv = sir;
+
+        sir.simulateDay(model);
+        CHECK(sir.countByState(State::Infectious) == 1);
+
+        model.type = ModelType::SIRV;
+        model.setBreakthroughRate(1.0);
+        sirv.simulateDay(model);
+        CHECK(sirv.countByState(State::Infectious) > 1);
+        CHECK(Simulation::dailyHeader(model).find("Exposed") == std::string::npos);
+    }
+}
+
+TEST_CASE("Vaccine Efficacy") {
+    // Bernoulli masks hit the requested probability
+    std::uint64_t state = 42;
+    auto next = [&] { return mixBits(++state); };
+    for (double p : {0.0, 0.1, 0.3, 0.5, 0.97, 1.0}) {
+        std::uint32_t bits = probabilityBits(p);
+        int ones = 0;
+        for (int w = 0; w < 2000; ++w) ones += __builtin_popcountll(bernoulliWord(bits, next));
+        CHECK(ones / (2000.0 * 64) == doctest::Approx(p).epsilon(0.02));
+    }
+
+    // Fully vaccinated population around one infectious person, every contact transmits
+    Population initial("Vaccinated", 20000, 1.0);
+    initial.individuals[0] = Person(State::Infectious);
+    auto infectedAfterOneDay = [&](VaccineMode mode, double efficacy) {
+        DiseaseModel model(3, 1.0, 1000);
+        model.vaccineMode = mode;
+        model.vaccineEfficacy = efficacy;
+        Population pop = initial;
+        pop.simulateDay(model);
+        return pop.countByState(State::Infectious);
+    };
+
+    seedRandomGenerator(5);
+    CHECK(infectedAfterOneDay(VaccineMode::Leaky, 1.0) == 1);
+    CHECK(infectedAfterOneDay(VaccineMode::AllOrNothing, 1.0) == 1);
+    // About 1000 contacts x 30% unprotected, minus repeated contacts
+    int leaky = infectedAfterOneDay(VaccineMode::Leaky, 0.7);
+    int allOrNothing = infectedAfterOneDay(VaccineMode::AllOrNothing, 0.7);
+    CHECK(leaky > 230);
+    CHECK(leaky < 370);
+    CHECK(allOrNothing > 230);
+    CHECK(allOrNothing < 370);
+
+    // A leaky contact's decision is keyed by the contact alone: more vaccinated people
+    // elsewhere don't shift the draws of the others
+    auto leakyInfected = [](double vaccinated) {
+        Population pop("Leaky", 4000, vaccinated);
+        pop.useCommonRandomNumbers(8);
+        for (int i = 3000; i < 4000; ++i) pop.individuals[i] = Person(State::Infectious);
+        DiseaseModel model(3, 1.0, 5);
+        model.vaccineEfficacy = 0.5;
+        pop.spreadInfections(model);
+        pop.progressInfections(model);
+        pop.applyNewInfections(model);
+        std::vector<bool> infected;
+        for (int i = 0; i < 1000; ++i) infected.push_back(pop.individuals[i].state == State::Infectious);
+        return infected;
+    };
+    CHECK(leakyInfected(0.25) == leakyInfected(0.5));
+
+    // The same probability within and between populations, finer than 1/100
+    DiseaseModel leakyModel(10, 1.0, 1);
+    leakyModel.vaccineEfficacy = 0.995;
+    auto halfInfectious = [](const std::string& name) {
+        Population pop(name, 400000, 0.5);
+        for (int i = 200000; i < 400000; ++i) pop.individuals[i] = Person(State::Infectious);
+        return pop;
+    };
+    Population within = halfInfectious("Within");
+    within.useCommonRandomNumbers(4);
+    within.spreadInfections(leakyModel);
+    within.progressInfections(leakyModel);
+    within.applyNewInfections(leakyModel);
+    double withinRate = (200000 - within.countByState(State::Vaccinated)) / 100000.0; // 1 in 2 contacts vaccinated
+
+    leakyModel.mixingRate = 1.0;
+    Simulation across(std::vector<Population>{halfInfectious("A"), halfInfectious("B")}, leakyModel);
+    across.useCommonRandomNumbers(4);
+    across.simulateInterPopulationContacts();
+    int vaccinatedLeft = across.populations[0].countByState(State::Vaccinated) +
+                         across.populations[1].countByState(State::Vaccinated);
+    double acrossRate = (400000 - vaccinatedLeft) / 100000.0; // 1 in 4 pairs infectious x vaccinated
+    CHECK(withinRate == doctest::Approx(0.005).epsilon(0.2));
+    CHECK(acrossRate == doctest::Approx(0.005).epsilon(0.2));
+}
+
+TEST_CASE("Intervention Schedule") {
+    std::vector<InterventionRule> rules = parseInterventions(
+        "5-10 transmissibility=0.05 contacts=2\n8-12 mixing=0.01 transmissibility=0.02\n"
+        "3 contacts=9\nbogus rule\n7-4 contacts=1\n6-8 speed=3");
+    REQUIRE(rules.size() == 3);
+
+    DiseaseModel base(3, 0.15);
+    std::vector<DiseaseModel> days = compileInterventions(base, rules);
+    REQUIRE(days.size() == 13);
+    CHECK(days[2].contactsPerDay == 5);
+    CHECK(days[3].contactsPerDay == 9);
+    CHECK(days[6].transmissibility == doctest::Approx(0.05));
+    CHECK(days[6].transmissionThreshold == drawThreshold(0.05));
+    CHECK(days[9].transmissibility == doctest::Approx(0.02));
+    CHECK(days[9].contactsPerDay == 2);
+    CHECK(days[9].mixingRate == doctest::Approx(0.01));
+    CHECK(days[12].mixingRate == doctest::Approx(0.01));
+    CHECK(days[12].transmissibility == doctest::Approx(0.02));
+    CHECK(days[11].contactsPerDay == 5);
+    CHECK(compileInterventions(base, {}).empty());
+
+    // Transmission switched off from the first day: the index case recovers alone
+    Population pop("Lockdown", 1000, 0.0);
+    pop.initializeInfection();
+    std::vector<Population> populations;
+    populations.push_back(std::move(pop));
+    Simulation sim(std::move(populations), DiseaseModel(3, 1.0, 20));
+    sim.setInterventions(parseInterventions("1-100 transmissibility=0"));
+    std::ostringstream rows;
+    while (sim.simulateNextDay(rows)) {
+    }
+    CHECK(sim.getDayCount() == 3);
+    CHECK(sim.populations[0].countByState(State::Recovered) == 1);
+
+    // Cross-population contacts follow the day's model and its vaccine handling too
+    auto crossInfections = [](const DiseaseModel& model, const std::string& rule, double vaccinated) {
+        std::vector<Population> populations;
+        populations.emplace_back("Source", 2000, 0.0);
+        populations.emplace_back("Target", 2000, vaccinated);
+        populations[0].individuals.assign(2000, Person(State::Infectious));
+        Simulation sim(std::move(populations), model);
+        sim.setInterventions(parseInterventions(rule));
+        sim.useCommonRandomNumbers(3);
+        std::ostringstream rows;
+        for (int day = 0; day < 5; ++day) {
+            sim.simulateNextDay(rows);
+        }
+        return sim.populations[1].countByState(State::Infectious);
+    };
+    DiseaseModel contagious(10, 1.0);
+    CHECK(crossInfections(contagious, "", 0.0) > 0);
+    CHECK(crossInfections(contagious, "1-10 transmissibility=0", 0.0) == 0);
+    CHECK(crossInfections(contagious, "", 1.0) == 0);
+    DiseaseModel leaky = contagious;
+    leaky.vaccineEfficacy = 0.5;
+    CHECK(crossInfections(leaky, "", 1.0) > 0);
+    DiseaseModel breakthrough = contagious;
+    breakthrough.type = ModelType::SIRV;
+    CHECK(crossInfections(breakthrough, "", 1.0) == 0);
+    breakthrough.setBreakthroughRate(0.5);
+    CHECK(crossInfections(breakthrough, "", 1.0) > 0);
+}
+
+TEST_CASE("Age-Structured Contacts") {
+    AliasTable table({1.0, 0.0, 3.0, 4.0});
+    std::vector<int> hits(4, 0);
+    std::uint64_t state = 7;
+    for (int i = 0; i < 80000; ++i) hits[table.sample(mixBits(++state))]++;
+    CHECK(hits[1] == 0);
+    CHECK(hits[0] / 80000.0 == doctest::Approx(0.125).epsilon(0.05));
+    CHECK(hits[3] / 80000.0 == doctest::Approx(0.5).epsilon(0.05));
+
+    CHECK(parseAgeStructure("0.5,0.5", "1,2 | 3").empty());
+    // A row that contacts nobody, or contacts into a group with no people, is rejected
+    CHECK(parseAgeStructure("0.5,0.5", "0,0 | 1,1").empty());
+    CHECK(parseAgeStructure("0.5,0", "1,1 | 1,0").empty());
+    CHECK(parseAgeStructure("0.5,-0.5", "1,0 | 1,0").empty());
+
+    // Groups that round down to nobody are never contacted, even from a row that only
+    // pointed at them
+    Population tiny("Tiny", 10, 0.0, parseAgeStructure("0.01,0.99", "1,0 | 0,1"));
+    REQUIRE(tiny.groupStart == std::vector<int>{0, 0, 10});
+    for (int slot = 0; slot < 1000; ++slot) {
+        int target = tiny.contactTargets[0].sample(mixBits(slot));
+        CHECK(tiny.groupStart[target + 1] > tiny.groupStart[target]);
+    }
+    AgeStructure ages = parseAgeStructure("0.25, 0.75", "1,0 | 0,1");
+    REQUIRE_FALSE(ages.empty());
+
+    Population pop("Aged", 1000, 0.2, ages);
+    CHECK(pop.groupStart == std::vector<int>{0, 250, 1000});
+    CHECK(pop.ageGroups[249] == 0);
+    CHECK(pop.ageGroups[250] == 1);
+    CHECK(pop.countByState(State::Vaccinated) == 50 + 150);
+    CHECK(pop.individuals[0].state == State::Vaccinated);
+    CHECK(pop.individuals[250].state == State::Vaccinated);
+
+    // With a diagonal matrix an infection never leaves its age group
+    pop.individuals[100] = Person(State::Infectious);
+    DiseaseModel model(3, 1.0, 5);
+    for (int day = 0; day < 30; ++day) {
+        pop.simulateDay(model);
+    }
+    int infectedYoung = 0, infectedOld = 0;
+    for (int i = 0; i < 1000; ++i) {
+        if (pop.individuals[i].state == State::Recovered || pop.individuals[i].state == State::Infectious) {
+            (i < 250 ? infectedYoung : infectedOld)++;
+        }
+    }
+    CHECK(infectedYoung > 100);
+    CHECK(infectedOld == 0);
+}
+
+TEST_CASE("Alias Table Sampling") {
+    AliasTable table({1.0, 2.0, 3.0, 4.0});
+    const std::size_t count = 200000;
+    std::vector<int> serial(count), parallel(count);
+    table.sampleBatch(3, count, serial.data(), 1);
+    table.sampleBatch(3, count, parallel.data(), 4);
+    CHECK(serial == parallel);
+
+    auto frequencies = [&](const AliasTable& t) {
+        std::vector<int> draws(count);
+        t.sampleBatch(11, count, draws.data(), 2);
+        std::vector<double> share(t.size(), 0.0);
+        for (int d : draws) share[d] += 1.0 / count;
+        return share;
+    };
+    std::vector<double> share = frequencies(table);
+    for (int i = 0; i < 4; ++i) CHECK(share[i] == doctest::Approx((i + 1) / 10.0).epsilon(0.03));
+
+    // Lowering a weight is handled by rejection, raising it rebuilds
+    table.setWeight(3, 1.0);
+    share = frequencies(table);
+    CHECK(share[3] == doctest::Approx(1.0 / 7.0).epsilon(0.03));
+    table.setWeight(0, 8.0);
+    share = frequencies(table);
+    CHECK(share[0] == doctest::Approx(8.0 / 14.0).epsilon(0.03));
+    table.setWeight(0, 0.0);  // Total falls below half: rebuilt
+    share = frequencies(table);
+    CHECK(share[0] == 0.0);
+
+    // Inter-population partners follow mobility: an immobile population is never reached
+    std::vector<Population> populations;
+    for (int p = 0; p < 3; ++p) {
+        populations.emplace_back("P" + std::to_string(p), 2000, 0.0);
+    }
+    populations[0].individuals.assign(2000, Person(State::Infectious));
+    populations[2].mobility = 0.0;
+    Simulation sim(std::move(populations), 3, 0.15);
+    for (int day = 0; day < 20; ++day) sim.simulateInterPopulationContacts();
+    CHECK(sim.populations[1].countByState(State::Infectious) > 0);
+    CHECK(sim.populations[2].countByState(State::Infectious) == 0);
+
+    sim.setMobility(2, 5.0);
+    for (int day = 0; day < 20; ++day) sim.simulateInterPopulationContacts();
+    CHECK(sim.populations[2].countByState(State::Infectious) > 0);
+}
+
+TEST_CASE("Distributed Partition") {
+    // Largest first onto the least loaded process
+    std::vector<int> bins = balanceByCost({4000, 15000, 1500, 7000, 9000, 2000}, 3);
+    CHECK(bins == std::vector<int>{2, 0, 1, 2, 1, 1});
+    CHECK(balanceByCost({5, 5}, 4) == std::vector<int>{0, 1});
+    CHECK(balanceByCost({1, 2, 3}, 1) == std::vector<int>{0, 0, 0});
+
+    // Keyed draws don't depend on other populations' draws, so a process holding only some
+    // populations reproduces their days
+    auto run = [](bool both) {
+        std::vector<Population> populations;
+        populations.emplace_back("A", 3000, 0.1);
+        populations.emplace_back("B", both ? 3000 : 0, 0.1);
+        Simulation sim(std::move(populations), 3, 0.3);
+        sim.useCommonRandomNumbers(7);
+        for (auto& pop : sim.populations) {
+            if (!pop.individuals.empty()) pop.initializeInfection();
+        }
+        for (int day = 0; day < 5; ++day) {
+            for (auto& pop : sim.populations) {
+                pop.spreadInfections(sim.getModel());
+                pop.progressInfections(sim.getModel());
+                pop.applyNewInfections(sim.getModel());
+            }
+        }
+        return sim.populations[0].countStates();
+    };
+    CHECK(run(true) == run(false));
+}
+
+TEST_CASE("Population Scheduler") {
+    // Every task runs exactly once, whichever worker ends up with it
+    std::vector<double> costs = {100, 1, 1, 50, 1, 1, 1, 30};
+    std::vector<std::atomic<int>> runs(costs.size());
+    parallelForStealing(costs, 3, [&](int task, int) { runs[task]++; });
+    for (const auto& count : runs) CHECK(count == 1);
+
+    // Keyed draws give the same days for any thread count, also when a population is chunked
+    auto run = [](int threads) {
+        std::vector<Population> populations;
+        populations.emplace_back("City", 3 * Population::chunkSize + 100, 0.2);
+        populations.emplace_back("Village", 1500, 0.0);
+        DiseaseModel model(3, 0.3);
+        model.vaccineEfficacy = 0.8;
+        Simulation sim(std::move(populations), model);
+        sim.setThreads(threads);
+        sim.useCommonRandomNumbers(11);
+        for (auto& pop : sim.populations) pop.initializeInfection();
+        std::ostringstream rows;
+        for (int day = 0; day < 12 && sim.simulateNextDay(rows); ++day) {
+        }
+        return rows.str();
+    };
+    CHECK(run(1) == run(4));
+
+    // One pool runs every loop of the run, each task exactly once
+    WorkerPool pool(3);
+    for (int loop = 0; loop < 50; ++loop) {
+        std::vector<std::atomic<int>> poolRuns(costs.size());
+        pool.runStealing(costs, [&](int task, int) { poolRuns[task]++; });
+        for (const auto& count : poolRuns) CHECK(count == 1);
+    }
+
+    // Without common random numbers a seeded parallel run is still reproducible
+    auto seededRun = [] {
+        seedRandomGenerator(17);
+        std::vector<Population> populations;
+        populations.emplace_back("City", 2 * Population::chunkSize, 0.2);
+        populations.emplace_back("Village", 1500, 0.0);
+        for (auto& pop : populations) pop.initializeInfection();
+        Simulation sim(std::move(populations), 3, 0.3);
+        sim.setThreads(4);
+        std::ostringstream rows;
+        for (int day = 0; day < 12 && sim.simulateNextDay(rows); ++day) {
+        }
+        return rows.str();
+    };
+    CHECK(seededRun() == seededRun());
+}
+
+TEST_CASE("Double-Buffered State") {
+    // Marking infections in tomorrow's states gives the same days as the index list
+    auto run = [](ModelType type, VaccineMode mode, bool doubleBuffered, int threads) {
+        std::vector<Population> populations;
+        populations.emplace_back("A", 5000, 0.3);
+        populations.emplace_back("B", Population::chunkSize + 2000, 0.1);
+        DiseaseModel model(5, 0.3);
+        model.type = type;
+        model.maxDays = 30;
+        model.vaccineEfficacy = 0.6;
+        model.vaccineMode = mode;
+        model.immunityDuration = 10;
+        Simulation sim(std::move(populations), model);
+        sim.useCommonRandomNumbers(5);
+        for (auto& pop : sim.populations) pop.initializeInfection();
+        sim.setDoubleBuffered(doubleBuffered);
+        sim.setThreads(threads);
+        std::ostringstream rows;
+        while (sim.simulateNextDay(rows)) {
+        }
+        return rows.str();
+    };
+    for (ModelType type : {ModelType::SIR, ModelType::SEIRS}) {
+        for (VaccineMode mode : {VaccineMode::Leaky, VaccineMode::AllOrNothing}) {
+            std::string rows = run(type, mode, false, 1);
+            CHECK(run(type, mode, true, 1) == rows);
+            CHECK(run(type, mode, true, 3) == rows);
+        }
+    }
+
+    // Nothing is marked in the bitmap
+    Population pop("P", 1000, 0.0);
+    pop.individuals.assign(1000, Person(State::Infectious));
+    pop.individuals[0] = Person(State::Susceptible);
+    pop.setDoubleBuffered(true);
+    pop.simulateDay(DiseaseModel(3, 1.0));
+    CHECK(std::all_of(pop.infectedTomorrow.begin(), pop.infectedTomorrow.end(),
+                      [](std::uint64_t word) { return word == 0; }));
+    CHECK(pop.nextIndividuals.size() == pop.individuals.size());
+
+    // Chunks progress into tomorrow's states, then spread into them concurrently
+    Population serial("P", 3 * Population::chunkSize, 0.2);
+    for (size_t i = 0; i < serial.individuals.size(); i += 7) serial.individuals[i] = Person(State::Infectious);
+    serial.useCommonRandomNumbers(13);
+    serial.setDoubleBuffered(true);
+    Population chunked = serial;
+    DiseaseModel model(3, 0.4);
+    model.type = ModelType::SEIR;
+    serial.simulateDay(model);
+    chunked.beginSpread(model);
+    std::vector<double> costs(chunked.chunkCount(), 1.0);
+    parallelForStealing(costs, 4, [&](int chunk, int) { chunked.progressChunk(model, chunk); });
+    parallelForStealing(costs, 4, [&](int chunk, int) { chunked.spreadChunk(model, chunk); });
+    chunked.applyNewInfections(model);
+    CHECK(serial.countByState(State::Exposed) > 0);
+    CHECK(chunked.countStates() == serial.countStates());
+}
+
+TEST_CASE("Concurrent Infection Marking") {
+    // Chunks spreading concurrently with atomic marks set exactly the bits of the serial day
+    Population serial("P", 3 * Population::chunkSize, 0.2);
+    for (size_t i = 0; i < serial.individuals.size(); i += 7) serial.individuals[i] = Person(State::Infectious);
+    serial.useCommonRandomNumbers(21);
+    Population chunked = serial;
+    DiseaseModel model(3, 0.4);
+    model.vaccineEfficacy = 0.5;
+
+    serial.spreadInfections(model);
+
+    chunked.beginSpread(model);
+    std::vector<double> costs(chunked.chunkCount(), 1.0);
+    parallelForStealing(costs, 4, [&](int chunk, int) { chunked.spreadChunk(model, chunk); });
+    CHECK(std::any_of(serial.infectedTomorrow.begin(), serial.infectedTomorrow.end(),
+                      [](std::uint64_t word) { return word != 0; }));
+    CHECK(chunked.infectedTomorrow == serial.infectedTomorrow);
+
+    // Applying per chunk clears the marks and gives the same states
+    serial.progressInfections(model);
+    serial.applyNewInfections(model);
+    parallelForStealing(costs, 4, [&](int chunk, int) {
+        chunked.progressChunk(model, chunk);
+        chunked.applyChunk(model, chunk);
+    });
+    CHECK(chunked.countStates() == serial.countStates());
+    CHECK(std::all_of(chunked.infectedTomorrow.begin(), chunked.infectedTomorrow.end(),
+                      [](std::uint64_t word) { return word == 0; }));
+}
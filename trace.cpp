@@ -0,0 +1,88 @@
+#include "trace.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+TraceRecorder& TraceRecorder::instance() {
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+TraceRecorder::TraceRecorder() : enabled(false), origin(std::chrono::steady_clock::now()) {}
+
+TraceRecorder::~TraceRecorder() {
+    write();
+}
+
+void TraceRecorder::enable(const std::string& filename) {
+    this->filename = filename;
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+std::uint64_t TraceRecorder::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+TraceRecorder::ThreadBuffer& TraceRecorder::localBuffer() {
+    static thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = buffers.back().get();
+        buffer->threadId = static_cast<int>(buffers.size());
+        buffer->events.reserve(4096);
+    }
+    return *buffer;
+}
+
+void TraceRecorder::record(const char* name, const char* category, const std::string& detail,
+                           std::uint64_t start, std::uint64_t end) {
+    localBuffer().events.push_back({name, category, detail, start, end - start});
+}
+
+// Minimal JSON string escaping for population names
+static void writeJsonString(std::ostream& out, const std::string& text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20) out << ' ';
+        else out << c;
+    }
+    out << '"';
+}
+
+void TraceRecorder::write() {
+    if (!isEnabled() || filename.empty()) {
+        return;
+    }
+    enabled.store(false, std::memory_order_relaxed);
+
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << " for writing the trace.\n";
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    out << std::fixed << std::setprecision(3);
+    for (const auto& buffer : buffers) {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+            << ",\"args\":{\"name\":\"" << (buffer->threadId == 1 ? "main" : "worker") << " " << buffer->threadId << "\"}}";
+        first = false;
+        for (const auto& event : buffer->events) {
+            out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0;
+            if (!event.detail.empty()) {
+                out << ",\"args\":{\"detail\":";
+                writeJsonString(out, event.detail);
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    std::cout << "Trace written to " << filename << "\n";
+}
@@ -0,0 +1,89 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Records complete ("X") events into per-thread buffers and writes them as
+// Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev). Each thread
+// appends only to its own buffer, so recording takes no locks; the buffers are
+// registered once per thread and read when the trace is written.
+class TraceRecorder {
+public:
+    static TraceRecorder& instance();
+
+    // Start recording; the trace is written to filename by write() or at exit
+    void enable(const std::string& filename);
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // Nanoseconds since the recorder was created
+    std::uint64_t now() const;
+
+    // name and category must outlive the recorder (string literals); detail is copied
+    void record(const char* name, const char* category, const std::string& detail,
+                std::uint64_t start, std::uint64_t end);
+
+    // Write all events recorded so far; call once worker threads have finished
+    void write();
+
+    ~TraceRecorder();
+
+private:
+    struct Event {
+        const char* name;
+        const char* category;
+        std::string detail;
+        std::uint64_t start;
+        std::uint64_t duration;
+    };
+
+    struct ThreadBuffer {
+        int threadId;
+        std::vector<Event> events;
+    };
+
+    TraceRecorder();
+    ThreadBuffer& localBuffer();
+
+    std::atomic<bool> enabled;
+    std::string filename;
+    std::chrono::steady_clock::time_point origin;
+    std::mutex registryMutex;  // Guards buffers, only taken when a thread records its first event
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+// Records the lifetime of the scope as one trace event when tracing is enabled
+class ScopedTrace {
+public:
+    ScopedTrace(const char* name, const char* category, const std::string& detail = std::string())
+        : name(name), category(category), active(TraceRecorder::instance().isEnabled()) {
+        if (active) {
+            this->detail = detail;
+            start = TraceRecorder::instance().now();
+        }
+    }
+
+    ~ScopedTrace() {
+        if (active) {
+            TraceRecorder& recorder = TraceRecorder::instance();
+            recorder.record(name, category, detail, start, recorder.now());
+        }
+    }
+
+    ScopedTrace(const ScopedTrace&) = delete;
+    ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+private:
+    const char* name;
+    const char* category;
+    bool active;
+    std::string detail;
+    std::uint64_t start = 0;
+};
+
+#endif // TRACE_H